@@ -0,0 +1,31 @@
+// Catmull-Rom in 9 bilinear taps, keeps edges sharper than plain bilinear
+vec3 SampleCatmullRom(sampler2D tex, vec2 uv)
+{
+    vec2 texSize   = vec2(textureSize(tex, 0));
+    vec2 samplePos = uv * texSize;
+    vec2 texPos1   = floor(samplePos - 0.5) + 0.5;
+    vec2 f = samplePos - texPos1;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+
+    // The two middle taps merge into one bilinear fetch
+    vec2 w12 = w1 + w2;
+    vec2 p0  = (texPos1 - 1.0) / texSize;
+    vec2 p3  = (texPos1 + 2.0) / texSize;
+    vec2 p12 = (texPos1 + w2 / w12) / texSize;
+
+    vec3 result = vec3(0.0);
+    result += texture(tex, vec2(p0.x,  p0.y)).rgb  * w0.x  * w0.y;
+    result += texture(tex, vec2(p12.x, p0.y)).rgb  * w12.x * w0.y;
+    result += texture(tex, vec2(p3.x,  p0.y)).rgb  * w3.x  * w0.y;
+    result += texture(tex, vec2(p0.x,  p12.y)).rgb * w0.x  * w12.y;
+    result += texture(tex, vec2(p12.x, p12.y)).rgb * w12.x * w12.y;
+    result += texture(tex, vec2(p3.x,  p12.y)).rgb * w3.x  * w12.y;
+    result += texture(tex, vec2(p0.x,  p3.y)).rgb  * w0.x  * w3.y;
+    result += texture(tex, vec2(p12.x, p3.y)).rgb  * w12.x * w3.y;
+    result += texture(tex, vec2(p3.x,  p3.y)).rgb  * w3.x  * w3.y;
+    return max(result, vec3(0.0));
+}
\ No newline at end of file
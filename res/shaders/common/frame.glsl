@@ -0,0 +1,14 @@
+// Per-frame constants, must match Deferred::FrameUniforms
+layout(std140, binding = 0) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    mat4 iProjMatrix;
+    mat4 iViewMatrix;
+    vec3 cPos;
+    vec3 cDir;
+    mat4 lightSpaceMatrices[3];
+    vec4 cascadeSplits;
+    mat4 viewProjection;     // Without jitter
+    mat4 prevViewProjection; // Without jitter, last frame
+    vec4 jitter;             // NDC offset of this frame in xy, of the last in zw
+};
\ No newline at end of file
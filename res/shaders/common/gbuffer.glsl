@@ -0,0 +1,65 @@
+// G-buffer encoding, must match the formats in Deferred::Allocate.
+// Packed: GAlbedo RGBA8 holds albedo and the material byte, GNormal RGB10_A2 holds the
+// octahedral normal in rg, the dir shadow factor in b and the selection mask in a.
+// RG16 would cut the normal error from 0.24 to under 0.01 degrees but leave no spare
+// channel, the shadow factor and mask would need their own targets again.
+// Wide: GAlbedo alpha is roughness, GNormal RGBA16F the normal and metallic
+uniform bool packedGBuffer;
+
+vec2 OctWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 EncodeOctahedral(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+    return e * 0.5 + 0.5;
+}
+
+vec3 DecodeOctahedral(vec2 e)
+{
+    e = e * 2.0 - 1.0;
+    vec3  n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+vec4 EncodeGNormal(vec3 n, float metallic)
+{
+    return packedGBuffer ? vec4(EncodeOctahedral(n), 0.0, 0.0) : vec4(n, metallic);
+}
+
+vec3 DecodeGNormal(vec4 texel)
+{
+    return packedGBuffer ? DecodeOctahedral(texel.rg) : normalize(texel.rgb);
+}
+
+// Six bits of roughness, two of metallic, only the packed layout is this short of room
+float PackMaterial(float roughness, float metallic)
+{
+    return (round(clamp(roughness, 0.0, 1.0) * 63.0) * 4.0 + round(clamp(metallic, 0.0, 1.0) * 3.0)) / 255.0;
+}
+
+void UnpackMaterial(float material, out float roughness, out float metallic)
+{
+    uint bits = uint(round(material * 255.0));
+    roughness = float(bits >> 2u) / 63.0;
+    metallic  = float(bits & 3u) / 3.0;
+}
+
+float EncodeGMaterial(float roughness, float metallic)
+{
+    return packedGBuffer ? PackMaterial(roughness, metallic) : roughness;
+}
+
+void DecodeGMaterial(vec4 albedo, vec4 normal, out float roughness, out float metallic)
+{
+    if (packedGBuffer) UnpackMaterial(albedo.a, roughness, metallic);
+    else {
+        roughness = albedo.a;
+        metallic  = normal.a;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+// Must match SM::InstanceData
+struct Instance
+{
+    mat4 model;
+    mat4 prevModel;
+    mat3 normalMatrix; // Inverse transpose of the model, columns padded to vec4
+    uint materialID; // Into the Materials SSBO
+};
+
+layout(std430, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
\ No newline at end of file
@@ -0,0 +1,34 @@
+// Must match SM::MaterialData. Maps are texture IDs into the bindless handle table of Textures,
+// -1 for none. The includer enables GL_ARB_bindless_texture, without it maps read as missing
+struct Material
+{
+    vec3  albedo;
+    float roughness;
+    float metallic;
+    float ao;
+    int   albedoMap;
+    int   metallicMap;
+    int   roughnessMap;
+    int   aoMap;
+};
+
+layout(std430, binding = 15) readonly buffer Materials {
+    Material materials[];
+};
+
+// Zero while a texture is decoding or has no levels resident
+layout(std430, binding = 16) readonly buffer TextureHandles {
+    uvec2 textureHandles[];
+};
+
+vec4 SampleMap(int map, vec2 uv, vec4 fallback)
+{
+#ifdef GL_ARB_bindless_texture
+    if (map < 0) return fallback;
+    uvec2 handle = textureHandles[map];
+    if (handle == uvec2(0)) return fallback;
+    return texture(sampler2D(handle), uv);
+#else
+    return fallback;
+#endif
+}
\ No newline at end of file
@@ -1,12 +1,29 @@
-#version 330 core
+#version 460
+#extension GL_ARB_bindless_texture : enable
 layout (location = 1) out vec4 gAlbedo;
-layout (location = 2) out vec3 gNormal;
+layout (location = 2) out vec4 gNormal;
+layout (location = 5) out vec2 gVelocity;
 
 in vec3 normal;
 in vec3 fragPos;
+in vec4 currClip;
+in vec4 prevClip;
+in vec2 texCoord;
+flat in uint materialID;
+
+#include "../common/gbuffer.glsl"
+#include "../common/materials.glsl"
 
 void main()
 {
-    gAlbedo = vec4(vec3(1.0), 1.0);
-    gNormal = normalize(normal);
+    Material material = materials[materialID];
+    vec3  albedo    = material.albedo * SampleMap(material.albedoMap, texCoord, vec4(1.0)).rgb;
+    float roughness = SampleMap(material.roughnessMap, texCoord, vec4(material.roughness)).r;
+    float metallic  = SampleMap(material.metallicMap,  texCoord, vec4(material.metallic)).r;
+
+    gAlbedo = vec4(albedo, EncodeGMaterial(roughness, metallic));
+    gNormal = EncodeGNormal(normalize(normal), metallic);
+
+    // Motion since the last frame in uv units, both positions without jitter
+    gVelocity = (currClip.xy / currClip.w - prevClip.xy / prevClip.w) * 0.5;
 }
\ No newline at end of file
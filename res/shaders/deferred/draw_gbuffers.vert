@@ -1,21 +1,33 @@
-#version 430
+#version 460
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNorm;
+layout (location = 2) in vec2 aTexCoord;
 
-layout(std430, binding = 0) buffer Matrices {
-    mat4 modelMatrices[];
+#include "../common/instances.glsl"
+
+// Instance slots grouped per draw command, indexed through gl_BaseInstance
+layout(std430, binding = 1) readonly buffer DrawIndices {
+    uint drawIndices[];
 };
 
 // uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "../common/frame.glsl"
 
 out vec3 normal;
 out vec3 fragPos;
+out vec4 currClip;
+out vec4 prevClip;
+out vec2 texCoord;
+flat out uint materialID;
 
 void main()
 {
-    mat4 model = modelMatrices[gl_InstanceID];
+    Instance instance = instances[drawIndices[gl_BaseInstance + gl_InstanceID]];
+    mat4 model = instance.model;
     gl_Position = projection * view * model * vec4(aPos, 1.0);
-    normal = mat3(view) * mat3(transpose(inverse(model))) * aNorm;
+    currClip = viewProjection * model * vec4(aPos, 1.0);
+    prevClip = prevViewProjection * instance.prevModel * vec4(aPos, 1.0);
+    texCoord   = aTexCoord;
+    materialID = instance.materialID;
+    normal = mat3(view) * instance.normalMatrix * aNorm;
 }
\ No newline at end of file
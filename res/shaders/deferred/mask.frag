@@ -1,9 +1,11 @@
 #version 330 core
+layout (location = 2) out vec4 gNormalMask; // Packed G-buffer, alpha only
 layout (location = 3) out float gMask;
 
 uniform int selected;
 
 void main()
 {
+    gNormalMask = vec4(1.0);
     gMask = 1.0;
 }
\ No newline at end of file
@@ -5,32 +5,40 @@ out vec4 FragColor;
 
 uniform sampler2D framebuffer;
 uniform sampler2D mask;
+uniform int maskChannel = 0; // Alpha of the packed normal target
 
-uniform int numSteps = 32;
 uniform vec2 size;
+uniform bool upscale = false; // framebuffer rendered below window size
 
-const float TAU = 6.28318530;
+// Nearest masked render pixel from the jump flood in Deferred::DrawMask, only valid inside outlineRect
+uniform isampler2D outlineSeeds;
+uniform ivec4 outlineRect;  // Render pixels, min xy inclusive, max zw exclusive
+uniform float outlineWidth; // Window pixels
+
+#include "../common/filtering.glsl"
 
 void main()
 {
-    float stencil = texture(mask, uvs).r;
-    vec3  shaded  = texture(framebuffer, uvs).rgb;
+    vec3 shaded = upscale ? SampleCatmullRom(framebuffer, uvs) : texture(framebuffer, uvs).rgb;
+
+    // Away from the selection nothing but the frame is read
+    ivec2 renderSize = textureSize(outlineSeeds, 0);
+    ivec2 pixel      = ivec2(uvs * vec2(renderSize));
+    if (any(lessThan(pixel, outlineRect.xy)) || any(greaterThanEqual(pixel, outlineRect.zw))) {
+        FragColor = vec4(shaded, 1.0);
+        return;
+    }
 
-    float aspectRatio = size.x / size.y;
-    float outlineThickness = 2.5 / size.x;
+    float stencil = texture(mask, uvs)[maskChannel];
 
+    // Distance to the nearest masked pixel in window pixels, antialiased over one pixel
     float outlinemask = 0.0;
-    for (float i = 0.0; i < TAU; i += TAU / numSteps) {
-        vec2 offset = vec2(sin(i), cos(i)) * outlineThickness;
-        offset.x *= 1.0;
-        offset.y *= aspectRatio;
-
-        outlinemask = mix(outlinemask, 1.0, texture(mask, uvs + offset).r);
+    ivec2 seed = texelFetch(outlineSeeds, pixel, 0).xy;
+    if (seed.x >= 0) {
+        float dist = length(((vec2(seed) + 0.5) / vec2(renderSize) - uvs) * size);
+        outlinemask = 1.0 - smoothstep(outlineWidth - 0.5, outlineWidth + 0.5, dist);
     }
 
-    float pixelSize = fwidth(outlinemask);
-    outlinemask = smoothstep(0.5 - pixelSize * 0.5, 0.5 + pixelSize * 0.5, outlinemask);
-
     vec3 outline_applied = mix(shaded, vec3(255, 159, 44) / 255.0, outlinemask - stencil);
 
     FragColor = vec4(outline_applied, 1.0);
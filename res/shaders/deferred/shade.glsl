@@ -0,0 +1,231 @@
+// Deferred PBR shading of one pixel at uvs, shared by shading.frag and shading_tiled.comp.
+// The includer declares uvs and defines PointLighting from its own light lists
+#include "../lighting/clusters.glsl"
+
+uniform sampler2D GAlbedo;
+uniform sampler2D GNormal;
+uniform sampler2D GDepth;
+uniform sampler2D GDirShadowFactor;
+
+// Half resolution occlusion in r with its view depth in g, from SSAO::Compute
+uniform sampler2D SSAO;
+uniform bool ssaoEnabled;
+
+#include "../common/frame.glsl"
+#include "../common/gbuffer.glsl"
+
+const vec3 BGcol = vec3(0.025, 0.025, 0.025);
+const float near = 0.1;
+const float far  = 1000.0;
+const float PI   = 3.1415926;
+
+// Fused, the shadow factor is evaluated here instead of being read back from the G-buffer
+uniform bool fusedShadows;
+#include "dir_shadow.glsl"
+
+vec3 ViewPosFromDepth(float depth);
+float AmbientOcclusion(float viewDepth);
+vec3 PointLighting(vec3 albedo, vec3 normal, float metallic, float roughness, float ao, vec3 viewPos, vec3 viewDir);
+
+vec3  fresnelSchlick(float cosTheta, vec3 F0);
+float DistributionGGX(vec3 N, vec3 H, float roughness);
+float GeometrySchlickGGX(float NdotV, float roughness);
+float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness);
+
+vec3 CalcDirLight(vec3 albedo, vec3 normal, float metallic, float roughness, float ao, vec3 viewPos, vec3 viewDir, float shadow);
+
+vec3 CalcPointLight(PointLight light, vec3 albedo, vec3 normal, float metallic, float roughness, float ao, vec3 viewPos, vec3 viewDir);
+vec3 CalcPointLightPhong(PointLight light, vec3 albedo, vec3 normal, vec3 viewpos, vec3 viewdir);
+
+highp float NoiseCalc = 1.0 / 255;
+highp float random(highp vec2 coords) { return fract(sin(dot(coords.xy, vec2(12.9898, 78.233))) * 43758.5453); }
+
+vec4 Shade()
+{
+    vec4  material  = texture(GAlbedo, uvs);
+    vec4  gNormal   = texture(GNormal, uvs);
+    vec3  albedo    = material.rgb;
+    vec3  normal    = DecodeGNormal(gNormal);
+    float metallic, roughness;
+    DecodeGMaterial(material, gNormal, roughness, metallic);
+    float depth = texture(GDepth, uvs).r;
+
+    vec3 viewPos   = ViewPosFromDepth(depth);
+    float ao       = depth < 0.9999 ? AmbientOcclusion(-viewPos.z) : 1.0;
+    vec4 worldPos  = iViewMatrix * vec4(viewPos, 1.0);
+    vec3 viewDir = normalize(-viewPos);
+
+    float dirShadow = 1.0;
+    if (!fusedShadows)       dirShadow = packedGBuffer ? gNormal.b : texture(GDirShadowFactor, uvs).r;
+    else if (depth < 0.9999) dirShadow = DirShadowFactor(depth, normal, viewPos);
+    float shadowStrength = 0.5;
+
+    vec3 ambient = BGcol * albedo * ao;
+    vec3 pointLighting = vec3(0.0);
+    if (depth < 0.9999) pointLighting = PointLighting(albedo, normal, metallic, roughness, ao, viewPos, viewDir);
+
+    vec3 dirLighting = CalcDirLight(albedo, normal, metallic, roughness, ao, viewPos, viewDir, 1.0);
+    dirLighting *= mix(1.0, dirShadow, shadowStrength);
+
+    vec3 final = ambient + pointLighting + dirLighting;
+
+    final  = final / (final + 1.0); // simple reinhardt tonemap
+    final  = pow(final, vec3(1.0 / 2.2));
+    final += mix(-NoiseCalc, NoiseCalc, random(uvs));
+
+    if (depth > 0.9999) return vec4(BGcol, 1.0);
+    return vec4(final, 1.0);
+}
+
+vec3 fresnelSchlick(float cosTheta, vec3 F0)
+{
+    return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
+}
+
+float DistributionGGX(vec3 N, vec3 H, float roughness)
+{
+    float a  = roughness * roughness;
+    float a2 = a * a;
+    float NdotH = max(dot(N, H), 0.0);
+    float NdotH2 = NdotH * NdotH;
+
+    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
+    return a2 / (PI * denom * denom);
+}
+
+float GeometrySchlickGGX(float NdotV, float roughness)
+{
+    float r = (roughness + 1.0);
+    float k = (r * r) / 8.0;
+    return NdotV / (NdotV * (1.0 - k) + k);
+}
+
+float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
+{
+    float NdotV = max(dot(N, V), 0.0);
+    float NdotL = max(dot(N, L), 0.0);
+    float ggx1 = GeometrySchlickGGX(NdotV, roughness);
+    float ggx2 = GeometrySchlickGGX(NdotL, roughness);
+    return ggx1 * ggx2;
+}
+
+vec3 CalcPointLight(PointLight light, vec3 albedo, vec3 normal, float metallic, float roughness, float ao, vec3 viewPos, vec3 viewDir)
+{
+    vec3 N = normal;
+    vec3 V = normalize(viewDir);
+    vec3 dir = mat3(view) * light.position - (viewPos + mat3(view) * cPos);
+    vec3 L = normalize(dir);
+    vec3 H = normalize(V + L);
+    float len = length(dir);
+    float attenuation = 1.0 / (len * len);
+
+    // Fades out to zero at the radius the light was binned with
+    float falloff = clamp(1.0 - pow(len / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= falloff * falloff;
+    vec3 radiance = light.color * light.intensity * attenuation;
+
+    // Fresnel reflectance at normal incidence
+    vec3 F0 = mix(vec3(0.04), albedo, metallic);
+
+    float NDF = DistributionGGX(N, H, roughness);
+    float G   = GeometrySmith(N, V, L, roughness);
+    vec3  F   = fresnelSchlick(max(dot(H, V), 0.0), F0);
+
+    vec3  nom   = NDF * G * F;
+    float denom = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0) + 0.001;
+    vec3  specular = nom / denom;
+
+    vec3 kS = F;
+    vec3 kD = vec3(1.0) - kS;
+    kD *= 1.0 - metallic;
+
+    float NdotL = max(dot(N, L), 0.0);
+    return (kD * albedo / PI + specular) * radiance * NdotL;
+}
+
+vec3 CalcDirLight(vec3 albedo, vec3 normal, float metallic, float roughness, float ao, vec3 viewPos, vec3 viewDir, float shadow)
+{
+    vec3 N = normal;
+    vec3 V = normalize(viewDir);
+    vec3 dir = mat3(view) * normalize(vec3(1.0, -1.0, 0.75));
+    vec3 L = normalize(dir);
+    vec3 H = normalize(V + L);
+    float len = length(dir);
+    float attenuation = 1.0 / (len * len);
+    vec3 radiance = vec3(7.5);
+
+    // Fresnel reflectance at normal incidence
+    vec3 F0 = mix(vec3(0.04), albedo, metallic);
+
+    float NDF = DistributionGGX(N, H, roughness);
+    float G   = GeometrySmith(N, V, L, roughness);
+    vec3  F   = fresnelSchlick(max(dot(H, V), 0.0), F0);
+
+    vec3  nom   = NDF * G * F;
+    float denom = 4.0 * max(dot(N, V), 0.0) * max(dot(N, L), 0.0) + 0.001;
+    vec3  specular = nom / denom;
+    specular = specular * shadow;
+
+    vec3 kS = F;
+    vec3 kD = vec3(1.0) - kS;
+    kD *= 1.0 - metallic;
+
+    float NdotL = max(dot(N, L), 0.0);
+    return (kD * albedo / PI + specular) * radiance * NdotL;
+}
+
+// ------------------------------------------------------------------
+
+vec3 ViewPosFromDepth(float depth)
+{
+    vec2 ndc = uvs * 2.0 - 1.0;
+    vec4 clip = vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    vec4 pos  = iProjMatrix * clip;
+    return pos.xyz / pos.w;
+}
+
+// Depth-aware upsample, the four half resolution texels around uvs weighted bilinearly and by
+// how close their depth is to this pixel's, so occlusion doesn't bleed across silhouettes
+float AmbientOcclusion(float viewDepth)
+{
+    if (!ssaoEnabled) return 1.0;
+
+    ivec2 size = textureSize(SSAO, 0);
+    vec2  pos  = uvs * vec2(size) - 0.5;
+    ivec2 base = ivec2(floor(pos));
+    vec2  f    = pos - vec2(base);
+
+    float sum = 0.0, total = 0.0;
+    for (int i = 0; i < 4; i++)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        vec2  t      = texelFetch(SSAO, clamp(base + offset, ivec2(0), size - 1), 0).rg;
+
+        vec2  bilinear = mix(1.0 - f, f, vec2(offset));
+        float w = (bilinear.x * bilinear.y + 1e-3) / (abs(t.g - viewDepth) + 1e-3 * viewDepth);
+        sum   += t.r * w;
+        total += w;
+    }
+    return sum / total;
+}
+
+// ------------------------------------------------------------------
+
+vec3 CalcPointLightPhong(PointLight light, vec3 albedo, vec3 normal, vec3 viewPos, vec3 viewDir)
+{
+    vec3 dist = mat3(view) * light.position - (viewPos + mat3(view) * cPos);
+    vec3 lightDir = normalize(dist); // normalize(mat3(view) * vec3(1.0, 0.75, 0.5));
+
+    float lambertian = max(dot(normal, lightDir), 0.0);
+    float specular = 0.0;
+    if (lambertian > 0.0)
+    {
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        specular = pow(max(dot(normal, halfwayDir), 0.0), 80) * 0.75;
+    }
+
+    float len = length(dist);
+    float attenuation = 1.0 / (len * len);
+
+    return albedo * (specular * light.intensity + lambertian * light.color * light.intensity) * attenuation;
+}
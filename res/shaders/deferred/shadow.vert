@@ -1,9 +1,11 @@
-#version 440
+#version 460
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNorm;
 
-layout(std430, binding = 0) buffer Matrices {
-    mat4 modelMatrices[];
+#include "../common/instances.glsl"
+
+layout(std430, binding = 1) readonly buffer DrawIndices {
+    uint drawIndices[];
 };
 
 uniform mat4 lightSpaceMatrix;
@@ -11,6 +13,6 @@ uniform mat4 lightSpaceMatrix;
 
 void main()
 {
-    mat4 model = modelMatrices[gl_InstanceID];
+    mat4 model = instances[drawIndices[gl_BaseInstance + gl_InstanceID]].model;
     gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
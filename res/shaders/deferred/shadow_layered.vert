@@ -0,0 +1,23 @@
+#version 460
+#extension GL_ARB_shader_viewport_layer_array : require
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNorm;
+
+#include "../common/instances.glsl"
+
+// Slot in the low bits, a single cascade bit from bit 29 up, see Culling::LayeredShadows
+layout(std430, binding = 1) readonly buffer DrawIndices {
+    uint drawIndices[];
+};
+
+#include "../common/frame.glsl"
+
+void main()
+{
+    uint entry = drawIndices[gl_BaseInstance + gl_InstanceID];
+    int  layer = findLSB(entry >> 29);
+    mat4 model = instances[entry & 0x1FFFFFFFu].model;
+
+    gl_Layer    = layer;
+    gl_Position = lightSpaceMatrices[layer] * model * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,4 @@
+#version 460
+
+// Depth only
+void main() {}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#version 460
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNorm;
+
+#include "../common/instances.glsl"
+
+// Slot in the low bits, the cascade mask from bit 29 up, see Culling::LayerMasks
+layout(std430, binding = 1) readonly buffer DrawIndices {
+    uint drawIndices[];
+};
+
+out vec3 vWorldPos;
+flat out uint vCascadeMask;
+
+void main()
+{
+    uint entry = drawIndices[gl_BaseInstance + gl_InstanceID];
+    mat4 model = instances[entry & 0x1FFFFFFFu].model;
+
+    vWorldPos    = vec3(model * vec4(aPos, 1.0));
+    vCascadeMask = entry >> 29;
+}
\ No newline at end of file
@@ -7,6 +7,7 @@ uniform sampler2D image;
 uniform bool isDepth       = false;
 uniform bool sampleStencil = false;
 uniform bool linearize     = false;
+uniform int  channel       = 0;
 
 float LinearizeDepth(float depth, float near, float far) {
     return (2.0 * near) / (far + near - depth * (far - near));
@@ -21,7 +22,7 @@ void main()
         else
         {
             if (linearize) color = vec4(vec3(LinearizeDepth(texture(image, uvs).r, 0.1, 1000.0)), 1.0);
-            else color = vec4(vec3(texture(image, uvs).r), 1.0);
+            else color = vec4(vec3(texture(image, uvs)[channel]), 1.0);
         }
     }
 }
\ No newline at end of file
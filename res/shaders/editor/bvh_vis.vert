@@ -4,8 +4,8 @@ layout (location = 1) in vec3 aNorm;
 
 uniform mat4 model;
 uniform mat4 parent;
-uniform mat4 view;
-uniform mat4 projection;
+
+#include "../common/frame.glsl"
 
 void main()
 {
@@ -8,8 +8,8 @@ layout (std430, binding = 0) buffer BVHVisBuffer {
 
 // uniform mat4 model;
 uniform mat4 parent;
-uniform mat4 view;
-uniform mat4 projection;
+
+#include "../common/frame.glsl"
 
 flat out int instanceID;
 
@@ -1,10 +1,10 @@
-#version 330 core
+#version 460
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNorm;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+#include "../common/frame.glsl"
 
 void main()
 {
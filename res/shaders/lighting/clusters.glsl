@@ -0,0 +1,18 @@
+// Must match Lighting::CLUSTERS_X/Y/Z, MAX_CLUSTER_LIGHTS and PointLightData
+#define CLUSTERS_X 16
+#define CLUSTERS_Y 9
+#define CLUSTERS_Z 24
+#define CLUSTER_COUNT (CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z)
+#define MAX_CLUSTER_LIGHTS 256
+
+struct PointLight
+{
+    vec3  position;
+    float radius;
+    vec3  color;
+    float intensity;
+};
+
+layout(std430, binding = 12) readonly buffer PointLights {
+    PointLight lights[];
+};
\ No newline at end of file
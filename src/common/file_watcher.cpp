@@ -0,0 +1,98 @@
+#include <map>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <filesystem>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "file_watcher.h"
+
+namespace fs = std::filesystem;
+
+namespace FileWatcher
+{
+#ifdef __linux__
+    // inotify isn't recursive, Folder and every folder below it get their own watch. Files
+    // already inside go to Found, a new folder can fill up before its watch exists
+    void watchTree(int fd, std::map<int, std::string>& folders, const std::string& folder, const std::function<void(const std::string& Path)>& Found)
+    {
+        int wd = inotify_add_watch(fd, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd >= 0) folders[wd] = folder;
+
+        std::error_code error;
+        for (const auto& entry : fs::directory_iterator(folder, error))
+        {
+            if (entry.is_directory(error)) watchTree(fd, folders, entry.path().string(), Found);
+            else if (Found) Found(entry.path().string());
+        }
+    }
+
+    void Watch(const std::string& Directory, const std::function<void(const std::string& Path)>& OnChange)
+    {
+        int fd = inotify_init1(IN_CLOEXEC);
+        if (fd < 0) {
+            std::cout << "[!] Couldn't watch " << Directory << "\n";
+            return;
+        }
+
+        std::map<int, std::string> folders;
+        watchTree(fd, folders, Directory, nullptr);
+
+        std::thread([fd, folders, OnChange]() mutable {
+            alignas(inotify_event) char buffer[4096];
+            while (true)
+            {
+                ssize_t length = read(fd, buffer, sizeof(buffer));
+                if (length <= 0) break;
+
+                for (char* ptr = buffer; ptr < buffer + length; ptr += sizeof(inotify_event) + ((inotify_event*)ptr)->len)
+                {
+                    const inotify_event* event = (const inotify_event*)ptr;
+                    if (event->mask & IN_IGNORED) {
+                        folders.erase(event->wd);
+                        continue;
+                    }
+
+                    auto folder = folders.find(event->wd);
+                    if (event->len == 0 || folder == folders.end()) continue;
+
+                    std::string path = folder->second + "/" + event->name;
+                    if (event->mask & IN_ISDIR) watchTree(fd, folders, path, OnChange);
+                    else if (!(event->mask & IN_CREATE)) OnChange(path); // Created files report once written
+                }
+            }
+            close(fd);
+        }).detach();
+    }
+#else
+    void Watch(const std::string& Directory, const std::function<void(const std::string& Path)>& OnChange)
+    {
+        std::thread([Directory, OnChange]() {
+            std::map<std::string, fs::file_time_type> writeTimes;
+            bool first = true;
+            while (true)
+            {
+                std::error_code error;
+                for (const auto& entry : fs::recursive_directory_iterator(Directory, error))
+                {
+                    if (!entry.is_regular_file()) continue;
+
+                    fs::file_time_type time = entry.last_write_time(error);
+                    auto [it, inserted] = writeTimes.try_emplace(entry.path().string(), time);
+                    if (!inserted && it->second != time) {
+                        it->second = time;
+                        OnChange(entry.path().string());
+                    }
+                    else if (inserted && !first) OnChange(entry.path().string());
+                }
+                first = false;
+                std::this_thread::sleep_for(std::chrono::milliseconds(250));
+            }
+        }).detach();
+    }
+#endif
+}
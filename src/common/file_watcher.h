@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+#include <functional>
+
+namespace FileWatcher
+{
+    // Calls OnChange from a background thread with the path of every file written or moved
+    // into Directory or any folder below it. Uses inotify on Linux and polls elsewhere.
+    void Watch(const std::string& Directory, const std::function<void(const std::string& Path)>& OnChange);
+}
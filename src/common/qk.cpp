@@ -39,6 +39,7 @@ namespace qk
         InitializeQuery("Shading");
         InitializeQuery("Post Process");
         InitializeQuery("UI");
+        InitializeQuery("Culling");
 
         glGenVertexArrays(1, &line_vao);
         glGenBuffers(1, &line_vbo);
@@ -346,16 +347,14 @@ namespace qk
     void DrawBVHCubesInstanced(const glm::mat4 parentMatrix, int lineWidth)
     {
         AM::S_BVHVisInstanced->Use();
-        AM::S_BVHVisInstanced->SetMatrix4("projection", AM::ProjMat4);
-        AM::S_BVHVisInstanced->SetMatrix4("view",       AM::ViewMat4);
         AM::S_BVHVisInstanced->SetMatrix4("parent",     parentMatrix);
         // AM::S_BVHVis->SetVector3("color",      glm::vec3(1.0f, 0.0f, 0.0f));
 
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
         glLineWidth(lineWidth);
 
-        glBindVertexArray(AM::Meshes.at("MV::CUBEOUTLINE").VAO);
-        glDrawElementsInstanced(GL_LINES, 24, GL_UNSIGNED_INT, 0, bvhVisMatrices.size());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bvhVisSSBO);
+        AM::DrawMesh(AM::Meshes.at("MV::CUBEOUTLINE"), GL_LINES, bvhVisMatrices.size());
 
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
@@ -370,8 +369,6 @@ namespace qk
         model = glm::scale(model, scale);
 
         AM::S_BVHVis->Use();
-        AM::S_BVHVis->SetMatrix4("projection", AM::ProjMat4);
-        AM::S_BVHVis->SetMatrix4("view",       AM::ViewMat4);
         AM::S_BVHVis->SetMatrix4("model",      model);
         AM::S_BVHVis->SetMatrix4("parent",     parentMatrix);
         AM::S_BVHVis->SetVector3("color",      color);
@@ -379,8 +376,7 @@ namespace qk
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
         glLineWidth(lineWidth);
 
-        glBindVertexArray(AM::Meshes.at("MV::CUBEOUTLINE").VAO);
-        glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
+        AM::DrawMesh(AM::Meshes.at("MV::CUBEOUTLINE"), GL_LINES);
 
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
@@ -392,8 +388,6 @@ namespace qk
         model = glm::scale(model, scale);
 
         AM::S_SingleColor->Use();
-        AM::S_SingleColor->SetMatrix4("projection", AM::ProjMat4);
-        AM::S_SingleColor->SetMatrix4("view",       AM::ViewMat4);
         AM::S_SingleColor->SetMatrix4("model",      model);
         AM::S_SingleColor->SetVector3("color",      color);
 
@@ -402,8 +396,7 @@ namespace qk
             glLineWidth(lineWidth);
         }
 
-        glBindVertexArray(AM::Meshes.at("MV::CUBE").VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        AM::DrawMesh(AM::Meshes.at("MV::CUBE"), GL_TRIANGLES);
 
         if (wireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
@@ -411,8 +404,6 @@ namespace qk
     void DrawDebugCubeMatrix(glm::mat4 matrix, glm::vec3 color, bool wireframe, int lineWidth)
     {
         AM::S_SingleColor->Use();
-        AM::S_SingleColor->SetMatrix4("projection", AM::ProjMat4);
-        AM::S_SingleColor->SetMatrix4("view",       AM::ViewMat4);
         AM::S_SingleColor->SetMatrix4("model",      matrix);
         AM::S_SingleColor->SetVector3("color",      color);
 
@@ -421,8 +412,7 @@ namespace qk
             glLineWidth(lineWidth);
         }
 
-        glBindVertexArray(AM::Meshes.at("MV::CUBE").VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        AM::DrawMesh(AM::Meshes.at("MV::CUBE"), GL_TRIANGLES);
 
         if (wireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
     }
@@ -434,8 +424,6 @@ namespace qk
         glm::mat4 model = glm::mat4(1.0);
 
         AM::S_SingleColor->Use();
-        AM::S_SingleColor->SetMatrix4("projection", AM::ProjMat4);
-        AM::S_SingleColor->SetMatrix4("view",       AM::ViewMat4);
         AM::S_SingleColor->SetMatrix4("model",      model);
         AM::S_SingleColor->SetVector3("color",      color);
 
@@ -462,8 +450,6 @@ namespace qk
         glm::mat4 model = glm::mat4(1.0);
 
         AM::S_SingleColor->Use();
-        AM::S_SingleColor->SetMatrix4("projection", AM::ProjMat4);
-        AM::S_SingleColor->SetMatrix4("view",       AM::ViewMat4);
         AM::S_SingleColor->SetMatrix4("model",      model);
         AM::S_SingleColor->SetVector3("color",      color);
 
@@ -489,13 +475,10 @@ namespace qk
         model = glm::rotate(model, glm::radians(-AM::EditorCam.Pitch),       glm::vec3(1.0f, 0.0f, 0.0f));
 
         AM::S_SingleColor->Use();
-        AM::S_SingleColor->SetMatrix4("projection", AM::ProjMat4);
-        AM::S_SingleColor->SetMatrix4("view",       AM::ViewMat4);
         AM::S_SingleColor->SetMatrix4("model",      model);
         AM::S_SingleColor->SetVector3("color",      color);
 
-        glBindVertexArray(AM::Meshes.at("plane").VAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        AM::DrawMesh(AM::Meshes.at("MV::PLANE"), GL_TRIANGLES);
     }
     
     void Todo(std::string message)
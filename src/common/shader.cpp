@@ -1,6 +1,13 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <vector>
+#include <mutex>
+#include <thread>
 
 #include "shader.h"
 #include "../common/stat_counter.h"
@@ -9,137 +16,517 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+namespace
+{
+    // Every live shader, looked up by source file when the watcher reports a change
+    std::vector<Shader*> allShaders;
+
+    // Programs linking in the background, checked by FinishPending or their first Use
+    std::vector<Shader*> pendingShaders;
+
+    // Filled from the watcher and reader threads, drained by UpdateHotReload
+    std::mutex                                     hotReloadMutex;
+    std::vector<std::string>                       changedFiles;
+    std::vector<std::pair<Shader*, Shader::Source>> readSources;
+
+    bool        parallelCompile = false;
+    std::string driverString;
+
+    double MillisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // FNV-1a, names the binary cache entry of a program
+    unsigned long long Hash(const std::string& data)
+    {
+        unsigned long long hash = 14695981039346656037ull;
+        for (unsigned char c : data) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    const char* StageToString(unsigned int stage)
+    {
+        switch (stage) {
+            case GL_VERTEX_SHADER:   return "Vertex";
+            case GL_GEOMETRY_SHADER: return "Geometry";
+            case GL_FRAGMENT_SHADER: return "Fragment";
+            case GL_COMPUTE_SHADER:  return "Compute";
+
+            default: return "Unknown";
+        }
+    }
+
+    std::string CanonicalPath(const std::string& path)
+    {
+        std::error_code error;
+        return std::filesystem::weakly_canonical(path, error).string();
+    }
+
+    // Source string number of a file in #line directives, its index in the program's file table
+    int FileIndex(std::vector<std::string>& files, const std::string& file)
+    {
+        auto it = std::find(files.begin(), files.end(), file);
+        if (it != files.end()) return it - files.begin();
+        files.push_back(file);
+        return files.size() - 1;
+    }
+
+    // Pastes #include "file" in place, paths are relative to the including file and every
+    // file is included once per stage. Every file read is numbered in Files, the table
+    // _checkLink prints, and #line directives point compile errors at file and line.
+    std::string Preprocess(const std::string& path, std::vector<std::string>& included, std::vector<std::string>& files, bool& ok)
+    {
+        std::ifstream file(path);
+        if (!file) {
+            std::cout << "Error. Shader file not successfully read, " << strerror(errno) << "\n\n";
+            std::cout << path << "\n";
+            ok = false;
+            return "";
+        }
+        std::string canonical = CanonicalPath(path);
+        included.push_back(canonical);
+        int index = FileIndex(files, canonical);
+
+        std::string out, line;
+        int number = 0;
+        while (std::getline(file, line))
+        {
+            number++;
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line.compare(start, 1, "#") != 0) {
+                out += line + "\n";
+                continue;
+            }
+
+            // Nothing may come before #version, the stage's own number follows it
+            if (line.compare(start, 8, "#version") == 0) {
+                out += line + "\n";
+                if (index != 0) out += std::format("#line {} {}\n", number + 1, index);
+                continue;
+            }
+            if (line.compare(start, 8, "#include") != 0) {
+                out += line + "\n";
+                continue;
+            }
+
+            size_t open  = line.find('"', start);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (close == std::string::npos) {
+                std::cout << "Malformed #include in " << path << ": " << line << "\n";
+                ok = false;
+                continue;
+            }
+
+            std::string include = (std::filesystem::path(path).parent_path() / line.substr(open + 1, close - open - 1)).string();
+            std::string includeCanonical = CanonicalPath(include);
+            if (std::find(included.begin(), included.end(), includeCanonical) != included.end()) continue;
+
+            out += std::format("#line 1 {}\n", FileIndex(files, includeCanonical)) + Preprocess(include, included, files, ok);
+            out += std::format("#line {} {}\n", number + 1, index);
+        }
+        return out;
+    }
+}
+
 Shader::Shader(std::string Path)
 {
     _shaderPath = Path;
+    allShaders.push_back(this);
 
     _createShader();
 }
 
+Shader::~Shader()
+{
+    allShaders.erase(std::remove(allShaders.begin(), allShaders.end(), this), allShaders.end());
+    pendingShaders.erase(std::remove(pendingShaders.begin(), pendingShaders.end(), this), pendingShaders.end());
+}
+
 void Shader::Use()
 {
+    if (_pending) _finish();
     glUseProgram(ID);
 }
 
+void Shader::FinishPending()
+{
+    // _finish removes the shader from the list
+    while (!pendingShaders.empty()) pendingShaders.back()->_finish();
+}
+
 void Shader::Reload()
 {
+    if (_pending) _finish();
+
+    unsigned int oldID = ID;
     _createShader();
+    glDeleteProgram(oldID);
 
     std::string base_filename = _shaderPath.substr(_shaderPath.find_last_of("/\\") + 1);
     std::cout << "Reloaded Shader: " << base_filename << std::endl;
 }
 
+void Shader::SourceChanged(const std::string& Path)
+{
+    std::lock_guard<std::mutex> lock(hotReloadMutex);
+    changedFiles.push_back(CanonicalPath(Path));
+}
+
+void Shader::UpdateHotReload()
+{
+    std::vector<std::string> changed;
+    std::vector<std::pair<Shader*, Source>> read;
+    {
+        std::lock_guard<std::mutex> lock(hotReloadMutex);
+        changed.swap(changedFiles);
+        read.swap(readSources);
+    }
+
+    // Sources of the affected programs are read and preprocessed off the main thread.
+    // A save during a read is remembered and read again once the current one is back
+    for (Shader* shader : allShaders)
+    {
+        bool affected = false;
+        for (const std::string& file : changed)
+            affected |= std::find(shader->_files.begin(), shader->_files.end(), file) != shader->_files.end();
+        if (!affected) continue;
+
+        if (shader->_reading) shader->_readAgain = true;
+        else shader->_startRead();
+    }
+
+    for (auto& [shader, source] : read)
+    {
+        if (std::find(allShaders.begin(), allShaders.end(), shader) == allShaders.end()) continue;
+        shader->_reading = false;
+        if (shader->_readAgain) {
+            shader->_readAgain = false;
+            shader->_startRead();
+        }
+        if (!source.Ok) continue;
+
+        // A newer save replaces a build that is still running
+        if (shader->_swapID) {
+            glDeleteProgram(shader->_swapID);
+            for (unsigned int stage : shader->_swapStages) glDeleteShader(stage);
+            shader->_swapStages.clear();
+        }
+        shader->_swapID     = _compile(source, shader->_swapStages);
+        shader->_swapSource = std::move(source);
+    }
+
+    // The running program is only replaced once its successor linked
+    for (Shader* shader : allShaders)
+    {
+        if (!shader->_swapID) continue;
+
+        int done = 1;
+        if (parallelCompile) glGetProgramiv(shader->_swapID, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done) continue;
+
+        std::string name = shader->_shaderPath.substr(shader->_shaderPath.find_last_of("/\\") + 1);
+        if (!_checkLink(shader->_swapID, shader->_swapStages, shader->_shaderPath, shader->_swapSource.Files)) {
+            glDeleteProgram(shader->_swapID);
+            shader->_swapID = 0;
+            std::cout << "Kept previous program: " << name << "\n";
+            continue;
+        }
+
+        if (shader->_pending) shader->_finish();
+        glDeleteProgram(shader->ID);
+        shader->ID     = shader->_swapID;
+        shader->_files = shader->_swapSource.Files;
+        shader->_cachePath = _cachePathOf(shader->_swapSource);
+        shader->_swapID = 0;
+
+        shader->_cacheUniformLocations();
+        shader->_saveBinary();
+        std::cout << "Reloaded Shader: " << name << std::endl;
+    }
+}
+
+void Shader::_startRead()
+{
+    _reading = true;
+    std::thread([shader = this, path = _shaderPath]() {
+        Source source = _readSource(path);
+        std::lock_guard<std::mutex> lock(hotReloadMutex);
+        readSources.push_back({ shader, std::move(source) });
+    }).detach();
+}
+
 void Shader::SetBool(const std::string &name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(_location(name), (int)value);
 }
 
 void Shader::SetInt(const std::string &name, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(_location(name), value);
 }
 
 void Shader::SetFloat(const std::string &name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(_location(name), value);
 }
 
 void Shader::SetVector3(const std::string &name, glm::vec3 value) const
 {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), value.x, value.y, value.z);
+    glUniform3f(_location(name), value.x, value.y, value.z);
 }
 
 void Shader::SetVector2(const std::string &name, glm::vec2 value) const
 {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), value.x, value.y);
+    glUniform2f(_location(name), value.x, value.y);
+}
+
+void Shader::SetVector4(const std::string &name, glm::vec4 value) const
+{
+    glUniform4f(_location(name), value.x, value.y, value.z, value.w);
+}
+
+void Shader::SetIVector4(const std::string &name, glm::ivec4 value) const
+{
+    glUniform4i(_location(name), value.x, value.y, value.z, value.w);
 }
 
 void Shader::SetMatrix4(const std::string &name, glm::mat4 value) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+    glUniformMatrix4fv(_location(name), 1, GL_FALSE, glm::value_ptr(value));
 }
 
-void Shader::_createShader()
+void Shader::SetIntArray(const std::string &name, const int* values, int count) const
+{
+    glUniform1iv(_location(name), count, values);
+}
+
+void Shader::SetVector4Array(const std::string &name, const glm::vec4* values, int count) const
+{
+    glUniform4fv(_location(name), count, glm::value_ptr(values[0]));
+}
+
+void Shader::SetMatrix4Array(const std::string &name, const glm::mat4* values, int count) const
+{
+    glUniformMatrix4fv(_location(name), count, GL_FALSE, glm::value_ptr(values[0]));
+}
+
+int Shader::_location(const std::string &name) const
 {
-    std::string fpath = Stats::ProjectPath + _shaderPath + ".frag";
-    std::string vpath = Stats::ProjectPath + _shaderPath + ".vert";
+    auto it = _uniformLocations.find(name);
+    if (it != _uniformLocations.end()) return it->second;
 
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
+    // Array elements past the first and names that aren't active, -1 is cached too
+    int location = glGetUniformLocation(ID, name.c_str());
+    _uniformLocations.emplace(name, location);
+    return location;
+}
 
-    // Make sure ifstream can throw exceptions
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+void Shader::_cacheUniformLocations()
+{
+    _uniformLocations.clear();
 
-    try
+    int count = 0, maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::string name(std::max(maxLength, 1), '\0');
+    for (int i = 0; i < count; i++)
     {
-        vShaderFile.open(vpath.c_str());
-        fShaderFile.open(fpath.c_str());
-        std::stringstream vShaderStream, fShaderStream;
+        int length = 0, size = 0;
+        unsigned int type;
+        glGetActiveUniform(ID, i, maxLength, &length, &size, &type, name.data());
 
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
+        // Block members report -1 and are skipped, arrays are reachable with and without [0]
+        std::string uniform = name.substr(0, length);
+        int location = glGetUniformLocation(ID, uniform.c_str());
+        if (location < 0) continue;
 
-        vShaderFile.close();
-        fShaderFile.close();
+        _uniformLocations[uniform] = location;
+        if (uniform.ends_with("[0]")) _uniformLocations[uniform.substr(0, uniform.size() - 3)] = location;
+    }
+}
+
+Shader::Source Shader::_readSource(const std::string& ShaderPath)
+{
+    Source source;
 
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+    // A .comp next to the path makes this a compute-only program, a .geom is optional
+    std::string base = Stats::ProjectPath + ShaderPath;
+    std::vector<std::pair<unsigned int, std::string>> stages;
+    if (std::filesystem::exists(base + ".comp")) stages.push_back({ GL_COMPUTE_SHADER, base + ".comp" });
+    else {
+        stages.push_back({ GL_VERTEX_SHADER, base + ".vert" });
+        if (std::filesystem::exists(base + ".geom")) stages.push_back({ GL_GEOMETRY_SHADER, base + ".geom" });
+        stages.push_back({ GL_FRAGMENT_SHADER, base + ".frag" });
     }
-    catch (std::ifstream::failure e)
+
+    for (const auto& [stage, path] : stages)
     {
-        std::cout << "Error. Shader file not successfully read, " << strerror(errno) << "\n\n";
-        std::cout << _shaderPath << "\n";
+        // Each stage gets its own include-once list, the file table is shared
+        std::vector<std::string> included;
+        source.Stages.push_back({ stage, Preprocess(path, included, source.Files, source.Ok) });
     }
+    return source;
+}
 
-    const char* vShaderCode = vertexCode.c_str();
-    const char* fShaderCode = fragmentCode.c_str();
+std::string Shader::_cachePathOf(const Source& Source)
+{
+    std::string key = driverString;
+    for (const auto& [stage, code] : Source.Stages) key += std::to_string(stage) + code;
+    return std::format("{}/cache/shaders/{:016x}.bin", Stats::ProjectPath, Hash(key));
+}
 
-    unsigned int vertexShader, fragmentShader;
-    int success;
-    char infoLog[512];
+void Shader::_createShader()
+{
+    auto start = std::chrono::steady_clock::now();
 
-    vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vShaderCode, NULL);
-    glCompileShader(vertexShader);
+    // Once per context, every driver thread may compile and the cache is keyed to this driver
+    if (driverString.empty()) {
+        parallelCompile = GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile;
+        if (GLAD_GL_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        else if (GLAD_GL_ARB_parallel_shader_compile) glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
 
-    // Error checking vertex shader
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        std::cout << "Vertex Shader Compilation failed: " << infoLog;
-        std::cout << _shaderPath << "\n\n";
+        driverString = std::string((const char*)glGetString(GL_VENDOR)) + (const char*)glGetString(GL_RENDERER) + (const char*)glGetString(GL_VERSION);
     }
 
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fShaderCode, NULL);
-    glCompileShader(fragmentShader);
+    Source source = _readSource(_shaderPath);
+    _files     = source.Files;
+    _cachePath = _cachePathOf(source);
 
-    // Error checking fragment shader
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
+    if (_loadBinary()) {
+        _cacheUniformLocations();
+        Cached++;
+        BuildMilliseconds += MillisecondsSince(start);
+        return;
+    }
+
+    // Compile and link are only issued here, with parallel compile the driver works on them
+    // in the background until the status is first read in _finish
+    ID = _compile(source, _stages);
+
+    _pending = true;
+    pendingShaders.push_back(this);
+    BuildMilliseconds += MillisecondsSince(start);
+
+    if (!parallelCompile) _finish();
+}
+
+unsigned int Shader::_compile(const Source& Source, std::vector<unsigned int>& Stages)
+{
+    unsigned int program = glCreateProgram();
+    for (const auto& [stage, code] : Source.Stages)
     {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        std::cout << "Fragment Shader Compilation failed: " << infoLog;
-        std::cout << _shaderPath << "\n\n";
+        const char* text = code.c_str();
+
+        unsigned int shader = glCreateShader(stage);
+        glShaderSource(shader, 1, &text, NULL);
+        glCompileShader(shader);
+        glAttachShader(program, shader);
+        Stages.push_back(shader);
     }
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+    return program;
+}
 
-    ID = glCreateProgram();
-    glAttachShader(ID, vertexShader);
-    glAttachShader(ID, fragmentShader);
-    glLinkProgram(ID);
+bool Shader::_checkLink(unsigned int Program, std::vector<unsigned int>& Stages, const std::string& ShaderPath, const std::vector<std::string>& Files)
+{
+    int success;
+    char infoLog[512];
 
-    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    // Blocks until this program is done, the others keep compiling
+    glGetProgramiv(Program, GL_LINK_STATUS, &success);
     if (!success)
     {
-        glGetProgramInfoLog(ID, 512, NULL, infoLog);
+        for (unsigned int shader : Stages)
+        {
+            int compiled, stage;
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+            glGetShaderiv(shader, GL_SHADER_TYPE, &stage);
+            if (compiled) continue;
+
+            glGetShaderInfoLog(shader, 512, NULL, infoLog);
+            std::cout << StageToString(stage) << " Shader Compilation failed: " << infoLog;
+            std::cout << ShaderPath << "\n\n";
+        }
+
+        glGetProgramInfoLog(Program, 512, NULL, infoLog);
         std::cout << "Shader Program failed to link: " << infoLog;
-        std::cout << _shaderPath << "\n\n";
+        std::cout << ShaderPath << "\n";
+
+        // Errors read <file>:<line>, numbered by the #line directives Preprocess wrote
+        for (size_t i = 0; i < Files.size(); i++) std::cout << std::format("  {}: {}\n", i, Files[i]);
+        std::cout << "\n";
     }
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    for (unsigned int shader : Stages) glDeleteShader(shader);
+    Stages.clear();
+    return success;
+}
+
+void Shader::_finish()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    bool success = _checkLink(ID, _stages, _shaderPath, _files);
+
+    _pending = false;
+    pendingShaders.erase(std::remove(pendingShaders.begin(), pendingShaders.end(), this), pendingShaders.end());
+
+    _cacheUniformLocations();
+    if (success) _saveBinary();
+
+    Compiled++;
+    BuildMilliseconds += MillisecondsSince(start);
+}
+
+bool Shader::_loadBinary()
+{
+    std::ifstream file(_cachePath, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+
+    // Format header followed by the binary, a truncated entry is compiled again
+    std::streamoff size = file.tellg();
+    if (size <= (std::streamoff)sizeof(unsigned int)) return false;
+    file.seekg(0);
+
+    unsigned int format = 0;
+    std::vector<char> binary(size - sizeof(format));
+    file.read((char*)&format, sizeof(format));
+    file.read(binary.data(), binary.size());
+    if (!file) return false;
+
+    ID = glCreateProgram();
+    glProgramBinary(ID, format, binary.data(), (int)binary.size());
+
+    // Rejected after a driver update the key didn't catch, falls back to compiling
+    int success;
+    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    if (success) return true;
+
+    glDeleteProgram(ID);
+    return false;
+}
+
+void Shader::_saveBinary()
+{
+    int formats = 0, length = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (formats == 0 || length == 0) return;
+
+    std::vector<char> binary(length);
+    unsigned int format = 0;
+    glGetProgramBinary(ID, length, &length, &format, binary.data());
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(_cachePath).parent_path(), error);
+
+    std::ofstream file(_cachePath, std::ios::binary);
+    file.write((const char*)&format, sizeof(format));
+    file.write(binary.data(), length);
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include <glm/gtc/matrix_transform.hpp>
 
 class Shader
@@ -8,18 +10,79 @@ class Shader
     public:
         unsigned int ID;
 
+        // Preprocessed stages of a program and every file they were read from, a file's
+        // index is its source string number in the stages' #line directives
+        struct Source
+        {
+            std::vector<std::pair<unsigned int, std::string>> Stages;
+            std::vector<std::string> Files;
+            bool Ok = true;
+        };
+
         Shader(std::string Path);
+        ~Shader();
 
+        // Programs are loaded from the binary cache when their sources and the driver match,
+        // otherwise compiled in the background where parallel compile is supported
         void Use();
         void Reload();
+
+        // Waits for every program still compiling, their status and errors are only read then
+        static void FinishPending();
+
+        // Hot reload, SourceChanged may be called from any thread. UpdateHotReload runs once per
+        // frame, rereads the programs using a changed file off-thread and swaps each one in
+        // only after its new version linked.
+        static void SourceChanged(const std::string& Path);
+        static void UpdateHotReload();
+
+        // Programs built from source and from the binary cache, and the CPU time spent on both
+        static inline int    Compiled          = 0;
+        static inline int    Cached            = 0;
+        static inline double BuildMilliseconds = 0.0;
+
         void SetBool(const std::string &name, bool value) const;
         void SetInt(const std::string &name, int value) const;
         void SetFloat(const std::string &name, float value) const;
         void SetVector2(const std::string &name, glm::vec2 value) const;
         void SetVector3(const std::string &name, glm::vec3 value) const;
+        void SetVector4(const std::string &name, glm::vec4 value) const;
+        void SetIVector4(const std::string &name, glm::ivec4 value) const;
         void SetMatrix4(const std::string &name, glm::mat4 value) const;
-    
+
+        // Whole arrays in one call, name is the array without an index
+        void SetIntArray(const std::string &name, const int* values, int count) const;
+        void SetVector4Array(const std::string &name, const glm::vec4* values, int count) const;
+        void SetMatrix4Array(const std::string &name, const glm::mat4* values, int count) const;
+
     private:
+        static Source       _readSource(const std::string& ShaderPath);
+        static std::string  _cachePathOf(const Source& Source);
+        static unsigned int _compile(const Source& Source, std::vector<unsigned int>& Stages);
+        static bool         _checkLink(unsigned int Program, std::vector<unsigned int>& Stages, const std::string& ShaderPath, const std::vector<std::string>& Files);
+
         void _createShader();
+        void _finish();
+        void _startRead();
+        bool _loadBinary();
+        void _saveBinary();
+        void _cacheUniformLocations();
+        int  _location(const std::string &name) const;
         std::string _shaderPath;
+        std::string _cachePath;
+
+        // Stages of a program that is still linking
+        bool _pending = false;
+        std::vector<unsigned int> _stages;
+
+        // Hot reload, files the program was built from and the replacement being built
+        std::vector<std::string>  _files;
+        bool                      _reading   = false;
+        bool                      _readAgain = false;
+        unsigned int              _swapID  = 0;
+        std::vector<unsigned int> _swapStages;
+        Source                    _swapSource;
+
+        // Filled with the active uniforms at link, anything else is looked up once on first use
+        mutable std::unordered_map<std::string, int> _uniformLocations;
 };
\ No newline at end of file
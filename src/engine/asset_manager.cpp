@@ -9,6 +9,9 @@ using namespace std::chrono;
 
 #include "asset_manager.h"
 #include "scene_manager.h"
+#include "geometry/simplify.h"
+#include "geometry/meshlets.h"
+#include "geometry/optimize.h"
 #include "render_engine.h"
 #include "../ui/text_renderer.h"
 #include "../ui/ui.h"
@@ -34,7 +37,7 @@ namespace AM
 
         Resize(Engine::GetWindowSize().x, Engine::GetWindowSize().y);
 
-        AddMeshByData(AM::Presets::CubeOutlineVtxData, AM::Presets::CubeOutlineIndices, "MV::CUBEOUTLINE");
+        AddMeshByData(AM::Presets::CubeOutlineVtxData, AM::Presets::CubeOutlineIndices, "MV::CUBEOUTLINE", true);
         AddMeshByData(std::vector<VtxData> {}, "MV::EMPTY");
         AddMeshByData(AM::Presets::PlaneVtxData, AM::Presets::PlaneIndices, "MV::PLANE");
         AddMeshByData(AM::Presets::CubeVtxData,  AM::Presets::CubeIndices,  "MV::CUBE");
@@ -48,89 +51,218 @@ namespace AM
         EditorCam.Front   = glm::vec3(0.0f, 1.0f, 0.0f);
     }
     
-    Mesh::Mesh(const std::vector<VtxData>& VertexData, std::vector<unsigned int> Indices)
+    void BindPoolAttributes()
     {
-        UseElements = true;
-        TriangleCount = Indices.size() / 3;
+        glBindVertexArray(Pool.VAO);
 
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        glBindBuffer(GL_ARRAY_BUFFER, Pool.VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Pool.EBO);
 
-        glBindVertexArray(VAO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VtxData), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VtxData), (void*)offsetof(VtxData, Normal));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VtxData), (void*)offsetof(VtxData, TexCoord));
+        glEnableVertexAttribArray(2);
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * VertexData.size(), &VertexData[0], GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER,  sizeof(unsigned int) * Indices.size(), &Indices[0], GL_STATIC_DRAW);
+    // Reallocates a pool buffer keeping its current contents
+    void GrowPoolBuffer(unsigned int& buffer, size_t usedBytes, size_t newBytes)
+    {
+        unsigned int grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, newBytes, nullptr, GL_STATIC_DRAW);
+
+        if (buffer != 0) {
+            if (usedBytes > 0) {
+                glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+            }
+            glDeleteBuffers(1, &buffer);
+        }
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)offsetof(VtxData, Normal));
-        glEnableVertexAttribArray(1);
+        buffer = grown;
+    }
+
+    void UploadToPool(Mesh& mesh, const std::vector<VtxData>& vertexData, const std::vector<unsigned int>& indices)
+    {
+        if (Pool.VAO == 0) glGenVertexArrays(1, &Pool.VAO);
+
+        mesh.VAO        = Pool.VAO;
+        mesh.BaseVertex = Pool.VertexCount;
+        mesh.FirstIndex = Pool.IndexCount;
+        mesh.IndexCount = indices.size();
 
+        if (vertexData.empty() || indices.empty()) return;
+
+        bool grown = false;
+        if (Pool.VertexCount + vertexData.size() > Pool.VertexCapacity) {
+            size_t capacity = std::max(Pool.VertexCount + vertexData.size(), Pool.VertexCapacity * 2);
+            GrowPoolBuffer(Pool.VBO, Pool.VertexCount * sizeof(VtxData), capacity * sizeof(VtxData));
+            Pool.VertexCapacity = capacity;
+            grown = true;
+        }
+        if (Pool.IndexCount + indices.size() > Pool.IndexCapacity) {
+            size_t capacity = std::max(Pool.IndexCount + indices.size(), Pool.IndexCapacity * 2);
+            GrowPoolBuffer(Pool.EBO, Pool.IndexCount * sizeof(unsigned int), capacity * sizeof(unsigned int));
+            Pool.IndexCapacity = capacity;
+            grown = true;
+        }
+        if (grown) BindPoolAttributes();
+
+        glBindBuffer(GL_ARRAY_BUFFER, Pool.VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, Pool.VertexCount * sizeof(VtxData), vertexData.size() * sizeof(VtxData), vertexData.data());
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
 
-        UniqueMeshTriCount += Indices.size() / 3;
-        vertexData = VertexData;
-        indices    = Indices;
+        // Uploaded through COPY_WRITE so the element binding of whatever VAO is bound stays untouched
+        glBindBuffer(GL_COPY_WRITE_BUFFER, Pool.EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, Pool.IndexCount * sizeof(unsigned int), indices.size() * sizeof(unsigned int), indices.data());
 
-        qk::StartTimer();
-        bvh.Build(VertexData);
-        std::cout << "[:] Built bvh for " << qk::FmtK(int(VertexData.size()) / 3) << " triangles in " << qk::StopTimer() << " seconds\n";
+        Pool.VertexCount += vertexData.size();
+        Pool.IndexCount  += indices.size();
+    }
 
-        // qk::StartTimer();
-        // /* EDITOR ONLY */ qk::PrepareBVHVis(bvh.bvhNodes);
-        // std::cout << "[:] Built bvh debug in " << qk::StopTimer() << " seconds\n";
+    void DrawMesh(const Mesh& mesh, unsigned int mode, int instanceCount)
+    {
+        glBindVertexArray(mesh.VAO);
+        glDrawElementsInstancedBaseVertex(mode, mesh.IndexCount, GL_UNSIGNED_INT,
+                                          (void*)(mesh.FirstIndex * sizeof(unsigned int)),
+                                          instanceCount, mesh.BaseVertex);
     }
 
-    Mesh::Mesh(const std::vector<VtxData> &VertexData)
+    // Cache and overdraw ordering of every LOD, LOD 0 is ordered per meshlet when it has them.
+    // Vertices are renumbered last so they are fetched in the order the indices use them.
+    void OptimizeIndices(MeshData& data)
     {
-        UseElements = false;
-        TriangleCount = VertexData.size() / 3;
+        for (const MeshLOD& lod : data.LODs) {
+            if (lod.IndexCount == 0) continue;
 
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
+            Geometry::OptimizeVertexCache(&data.Indices[lod.FirstIndex], lod.IndexCount, data.VertexData.size());
+            if (lod.FirstIndex > 0) Geometry::OptimizeOverdraw(&data.Indices[lod.FirstIndex], lod.IndexCount, data.VertexData);
+        }
 
-        glBindVertexArray(VAO);
+        Geometry::BuildMeshlets(data);
+        if (data.Meshlets.empty()) Geometry::OptimizeOverdraw(data.Indices.data(), data.LODs[0].IndexCount, data.VertexData);
+        else                       Geometry::OptimizeMeshlets(data);
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * VertexData.size(), &VertexData[0], GL_STATIC_DRAW);
+        Geometry::OptimizeVertexFetch(data);
+    }
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), 0);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)offsetof(VtxData, Normal));
-        glEnableVertexAttribArray(1);
+    // qk's timer is shared, meshes are also prepared on loader threads
+    double secondsSince(high_resolution_clock::time_point start)
+    {
+        return duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000000.0;
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+    // Simplified levels are appended behind LOD 0 inside the mesh's own index range,
+    // then every range is reordered for the vertex cache and overdraw. Never touches GL
+    void PrepareMeshData(MeshData& data)
+    {
+        auto start = high_resolution_clock::now();
+        Geometry::GenerateLODs(data);
+        double seconds = secondsSince(start);
+
+        float acmrBefore = Geometry::ACMR(data.Indices.data(), data.LODs[0].IndexCount, data.VertexData.size());
 
+        start = high_resolution_clock::now();
+        OptimizeIndices(data);
+        double optimizeSeconds = secondsSince(start);
+
+        float acmrAfter = Geometry::ACMR(data.Indices.data(), data.LODs[0].IndexCount, data.VertexData.size());
+
+        if (data.LODs.size() > 1) {
+            std::cout << "[:] Generated " << data.LODs.size() - 1 << " LODs (";
+            for (size_t i = 1; i < data.LODs.size(); i++)
+                std::cout << (i > 1 ? " / " : "") << qk::FmtK(int(data.LODs[i].IndexCount / 3));
+            std::cout << " triangles) in " << seconds << " seconds\n";
+        }
+        if (data.LODs[0].IndexCount > 0)
+            std::cout << "[:] Optimized indices into " << data.Meshlets.size() << " meshlets, ACMR " << acmrBefore << " -> " << acmrAfter
+                      << " in " << optimizeSeconds << " seconds\n";
+    }
+
+    // Line lists come without LODs and are uploaded as given
+    void Mesh::Upload(MeshData& Prepared)
+    {
+        UploadToPool(*this, Prepared.VertexData, Prepared.Indices);
         UniqueMeshTriCount += TriangleCount;
+
+        if (Prepared.LODs.empty()) {
+            LODs = { { FirstIndex, IndexCount, 0.0f } };
+            return;
+        }
+
+        IndexCount = Prepared.LODs[0].IndexCount;
+        LODs       = Prepared.LODs;
+        Meshlets   = Prepared.Meshlets;
+        for (MeshLOD& lod : LODs)         lod.FirstIndex     += FirstIndex;
+        for (Meshlet& meshlet : Meshlets) meshlet.FirstIndex += FirstIndex;
+    }
+
+    Mesh::Mesh(const std::vector<VtxData>& VertexData, std::vector<unsigned int> Indices, bool LineList)
+    {
+        TriangleCount = Indices.size() / 3;
+        aabb          = AABB::FromVertices(VertexData);
+
+        MeshData data;
+        data.VertexData = VertexData;
+        data.Indices    = Indices;
+        if (!LineList) PrepareMeshData(data);
+        Upload(data);
+
         vertexData = VertexData;
-        
-        qk::StartTimer();
+        indices    = Indices;
+
+        auto start = high_resolution_clock::now();
         bvh.Build(VertexData);
-        std::cout << "[:] Built bvh for " << qk::FmtK(int(VertexData.size()) / 3) << " triangles in " << qk::StopTimer() << " seconds\n";
+        std::cout << "[:] Built bvh for " << qk::FmtK(int(VertexData.size()) / 3) << " triangles in " << secondsSince(start) << " seconds\n";
 
         // qk::StartTimer();
         // /* EDITOR ONLY */ qk::PrepareBVHVis(bvh.bvhNodes);
         // std::cout << "[:] Built bvh debug in " << qk::StopTimer() << " seconds\n";
     }
 
+    Mesh::Mesh(const std::vector<VtxData>& VertexData, MeshData& Prepared)
+    {
+        TriangleCount = VertexData.size() / 3;
+        aabb          = AABB::FromVertices(VertexData);
+
+        // Soups are welded first, the simplifier needs shared vertices to collapse edges.
+        // The BVH below keeps working on the original soup.
+        Prepared = Geometry::WeldVertices(VertexData);
+        PrepareMeshData(Prepared);
+
+        vertexData = VertexData;
+
+        auto start = high_resolution_clock::now();
+        bvh.Build(VertexData);
+        std::cout << "[:] Built bvh for " << qk::FmtK(int(VertexData.size()) / 3) << " triangles in " << secondsSince(start) << " seconds\n";
+    }
+
     void AddMeshByData(const std::vector<VtxData>& VertexData, std::string Name)
     {
-        Meshes.insert( {Name, Mesh(VertexData)} );
-        MeshNames.push_back(Name);
-        SM::UpdateDrawList();
+        MeshData data;
+        Mesh mesh(VertexData, data);
+        AddPreparedMesh(std::move(mesh), data, Name);
     }
 
-    void AddMeshByData(const std::vector<VtxData>& VertexData, std::vector<unsigned int> Indices, std::string Name)
+    void AddMeshByData(const std::vector<VtxData>& VertexData, std::vector<unsigned int> Indices, std::string Name, bool LineList)
     {   
-        Meshes.insert( {Name, Mesh(VertexData, Indices)} );
+        Meshes.insert( {Name, Mesh(VertexData, Indices, LineList)} );
         MeshNames.push_back(Name);
-        SM::UpdateDrawList();
+        SM::OnMeshLoaded(Name);
+    }
+
+    void AddPreparedMesh(Mesh&& Mesh, MeshData& Prepared, std::string Name)
+    {
+        Mesh.Upload(Prepared);
+        Meshes.insert( {Name, std::move(Mesh)} );
+        MeshNames.push_back(Name);
+        SM::OnMeshLoaded(Name);
     }
 
     void Resize(int width, int height)
@@ -229,6 +361,16 @@ namespace AM
         return finalMatrix;
     }
 
+    AABB AABB::FromVertices(const std::vector<VtxData>& vertices)
+    {
+        AABB aabb;
+        for (const VtxData& v : vertices) {
+            aabb.min = glm::min(aabb.min, v.Position);
+            aabb.max = glm::max(aabb.max, v.Position);
+        }
+        return aabb;
+    }
+
     AABB AABB::Compute(const std::vector<VtxData>& vertices, const std::vector<Tri>& triIndices, unsigned int start, unsigned int count)
     {
         AABB aabb;
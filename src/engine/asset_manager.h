@@ -15,15 +15,37 @@ namespace AM
     {
         glm::vec3 Position;
         glm::vec3 Normal;
+        glm::vec2 TexCoord = glm::vec2(0.0f);
         
         VtxData() = default;
-        VtxData(glm::vec3 pos, glm::vec3 norm) : Position(pos), Normal(norm) {}
+        VtxData(glm::vec3 pos, glm::vec3 norm, glm::vec2 uv = glm::vec2(0.0f)) : Position(pos), Normal(norm), TexCoord(uv) {}
+    };
+
+    // One simplified index range, every LOD of a mesh shares the same vertices
+    struct MeshLOD
+    {
+        unsigned int FirstIndex = 0;
+        unsigned int IndexCount = 0;
+        float        Error      = 0.0f; // Object space deviation from LOD 0
+    };
+
+    // Contiguous run of LOD 0 triangles, bounds and normal cone are in object space
+    struct Meshlet
+    {
+        glm::vec3    Center;
+        float        Radius     = 0.0f;
+        glm::vec3    ConeAxis;
+        float        ConeCutoff = 1.0f; // 1 never rejects
+        unsigned int FirstIndex = 0;
+        unsigned int IndexCount = 0;
     };
 
     struct MeshData
     {
         std::vector<VtxData> VertexData;
         std::vector<unsigned int> Indices;
+        std::vector<MeshLOD> LODs;
+        std::vector<Meshlet> Meshlets;
     };
 
     struct Tri
@@ -49,6 +71,7 @@ namespace AM
         glm::mat4 GetMatrixRelativeToParent(const glm::mat4& ParentMatrix);
 
         static AABB Compute(const std::vector<VtxData>& vertices, const std::vector<Tri>& triIndices, unsigned int start, unsigned int count);
+        static AABB FromVertices(const std::vector<VtxData>& vertices);
         static AABB Combine(const AABB& a, const AABB& b);
         static int getLongestAxis(const AABB& aabb);
         void Merge(const AABB& other);
@@ -105,10 +128,14 @@ namespace AM
     struct Mesh
     {
         unsigned int VAO;
-        unsigned int VBO;
-        unsigned int EBO;
-        int  TriangleCount;
-        bool UseElements;
+        int TriangleCount;
+
+        // Location of this mesh inside the shared MeshPool buffers, First/IndexCount are LOD 0
+        unsigned int BaseVertex = 0;
+        unsigned int FirstIndex = 0;
+        unsigned int IndexCount = 0;
+        std::vector<MeshLOD> LODs;
+        std::vector<Meshlet> Meshlets;
 
         std::vector<VtxData> vertexData;
         std::vector<unsigned int> indices;
@@ -118,13 +145,44 @@ namespace AM
         unsigned int nodesUsed  = 1;
         BVH bvh;
         
-        Mesh(const std::vector<VtxData>& VertexData);
-        Mesh(const std::vector<VtxData>& VertexData, std::vector<unsigned int> Faces);
+        // Line lists are uploaded as given, LODs, meshlets and reordering only apply to triangles
+        Mesh(const std::vector<VtxData>& VertexData, std::vector<unsigned int> Faces, bool LineList = false);
+
+        // Welds a triangle soup, builds its LODs, meshlets and BVH into Prepared without touching GL,
+        // so loader threads can run it. Upload places Prepared in the pool on the main thread
+        Mesh(const std::vector<VtxData>& VertexData, MeshData& Prepared);
+        void Upload(MeshData& Prepared);
     };
 
+    // Decoded texture with its whole mip chain, level 0 first, every level tightly packed
+    struct TextureData
+    {
+        unsigned int Format = 0; // Sized GL internal format, RGBA8, SRGB8_ALPHA8 or one of the BC7 formats
+        bool Compressed = false;
+        int  Width  = 0;
+        int  Height = 0;
+        std::vector<std::vector<unsigned char>> Mips;
+    };
+
+    // All meshes share one vertex and one index buffer so the batched passes
+    // can render every mesh with a single glMultiDrawElementsIndirect
+    struct MeshPool
+    {
+        unsigned int VAO = 0;
+        unsigned int VBO = 0;
+        unsigned int EBO = 0;
+        size_t VertexCount    = 0;
+        size_t VertexCapacity = 0;
+        size_t IndexCount     = 0;
+        size_t IndexCapacity  = 0;
+    };
+    inline MeshPool Pool;
+
     void Initialize();
+    void DrawMesh(const Mesh& mesh, unsigned int mode, int instanceCount = 1);
     void AddMeshByData(const std::vector<VtxData>& VertexData, std::string Name);
-    void AddMeshByData(const std::vector<VtxData>& VertexData, std::vector<unsigned int> Faces, std::string Name);
+    void AddMeshByData(const std::vector<VtxData>& VertexData, std::vector<unsigned int> Faces, std::string Name, bool LineList = false);
+    void AddPreparedMesh(Mesh&& Mesh, MeshData& Prepared, std::string Name);
     // std::vector<glm::vec3> ExtractPositionsFromVtxData(const std::vector<VtxData>& vertexData);
     
     inline std::unordered_map<std::string, Mesh> Meshes;
@@ -146,8 +204,13 @@ namespace AM
 
     namespace IO
     {
+        std::vector<VtxData> LoadObjFile(const std::string& Path);
         void LoadObjAsync(const std::string& Path, std::string MeshName);
         void LoadObjFolderAsync(const std::string& folderPath, const std::string& meshNamePrefix);
+
+        // KTX2 without supercompression, RGBA8 or BC7. Levels the file leaves out are box filtered
+        // when it is RGBA8, block compressed files keep the levels they ship with
+        TextureData LoadKtx2File(const std::string& Path);
     };
 
     namespace Presets
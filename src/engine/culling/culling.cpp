@@ -0,0 +1,956 @@
+#include <cmath>
+#include <memory>
+#include <format>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CULLING_SSE
+#endif
+
+#include <glad/glad.h>
+
+#include "culling.h"
+#include "../render_engine.h"
+#include "../geometry/simplify.h"
+#include "../../common/shader.h"
+
+namespace Culling
+{
+    void ReloadShaders();
+    void Resize(int width, int height);
+
+    std::unique_ptr<Shader> S_reset;
+    std::unique_ptr<Shader> S_cull;
+    std::unique_ptr<Shader> S_compact;
+    std::unique_ptr<Shader> S_depthPyramid;
+
+    // GPU path, see UploadBatches and CullViewsGPU
+    unsigned int _batchSSBO;
+    unsigned int _groupSSBO;
+    unsigned int _instanceBatchSSBO;
+    unsigned int _commandSSBO;
+    unsigned int _compactedBuffer;
+    unsigned int _counterBuffer;
+    unsigned int _drawIndexSSBO;
+    unsigned int _statsBuffer;
+    unsigned int _occludedSSBO;
+    unsigned int _meshletSSBO;
+    unsigned int _clusterCommandBuffer;
+    GLsync       _statsFence = nullptr;
+
+    // Max-reduced copy of GDepth, valid for the camera matrix it was built with
+    unsigned int _depthPyramid  = 0;
+    int          _pyramidLevels = 0;
+    glm::ivec2   _pyramidSize;
+    glm::mat4    _pyramidViewProj;
+    glm::mat4    _cameraViewProj;
+    bool         _pyramidValid  = false;
+
+    unsigned int _batchCount     = 0;
+    unsigned int _groupCount     = 0;
+    unsigned int _slotCount      = 0;
+    unsigned int _instanceCount  = 0;
+    unsigned int _instanceStride = 0;
+
+    // Cluster draws get one command and one draw index each, per camera phase. An instance whose
+    // meshlet ranges don't fit any more is drawn whole, about 3 MB of commands and indices in all
+    const unsigned int CLUSTER_BUDGET = 1 << 16;
+    unsigned int _meshletCount = 0;
+
+    // Flags dynamic objects in the InstanceBatches SSBO, the rest of the value is the batch
+    const unsigned int DYNAMIC_INSTANCE_BIT = 0x80000000u;
+
+    // CPU copy of the InstanceBatches SSBO, patched per slot between layouts. It and the
+    // occlusion flags only get reallocated once the slots outgrow them
+    std::vector<unsigned int> _instanceBatch;
+    size_t _instanceBatchDirtyBegin = SIZE_MAX;
+    size_t _instanceBatchDirtyEnd   = 0;
+    size_t _slotCapacity            = 0;
+
+    // Draw indices of the Shadows view keep the slot in the low bits and the cascade mask above.
+    // The view can hold every instance once per cascade, it spans three view strides.
+    const unsigned int CASCADE_MASK_SHIFT = 29;
+    const unsigned int VIEW_STRIDES       = NumViews + 2;
+
+    // Counters buffer, per view draw and visible counts followed by the cluster counters
+    const size_t COUNTERS_SIZE = (NumViews * 2 + 4) * sizeof(unsigned int);
+
+    // Camera terms of the LOD metric and the cone test, refreshed by CullViews
+    glm::vec3 _cameraPosition;
+    float     _lodScale = 0.0f;
+
+    // CPU path, visible slots of the current batch bucketed by LOD
+    std::vector<unsigned int> _lodSlots[AM::Geometry::MAX_LODS];
+
+    // CPU path, cascades every slot was found in when LayeredShadows is on
+    std::vector<uint8_t> _cascadeMasks;
+
+    void Initialize()
+    {
+        Engine::RegisterEditorReloadShadersFunction(ReloadShaders);
+
+        S_reset        = std::make_unique<Shader>("/res/shaders/culling/reset");
+        S_cull         = std::make_unique<Shader>("/res/shaders/culling/cull");
+        S_compact      = std::make_unique<Shader>("/res/shaders/culling/compact");
+        S_depthPyramid = std::make_unique<Shader>("/res/shaders/culling/depth_pyramid");
+
+        glGenBuffers(1, &_batchSSBO);
+        glGenBuffers(1, &_groupSSBO);
+        glGenBuffers(1, &_instanceBatchSSBO);
+        glGenBuffers(1, &_commandSSBO);
+        glGenBuffers(1, &_compactedBuffer);
+        glGenBuffers(1, &_counterBuffer);
+        glGenBuffers(1, &_drawIndexSSBO);
+        glGenBuffers(1, &_statsBuffer);
+        glGenBuffers(1, &_occludedSSBO);
+        glGenBuffers(1, &_meshletSSBO);
+        glGenBuffers(1, &_clusterCommandBuffer);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _counterBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, COUNTERS_SIZE, nullptr, GL_DYNAMIC_COPY);
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, _statsBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, COUNTERS_SIZE, nullptr, GL_STREAM_READ);
+
+        // Fixed size whatever the scene, both camera phases
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _clusterCommandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * CLUSTER_BUDGET * sizeof(SM::DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_COPY);
+
+        Resize(Engine::GetWindowSize().x, Engine::GetWindowSize().y);
+    }
+
+    void Resize(int width, int height)
+    {
+        if (width <= 0 || height <= 0) return;
+
+        // Storage is immutable, a new size needs a new texture
+        if (_depthPyramid) glDeleteTextures(1, &_depthPyramid);
+
+        _pyramidSize   = glm::ivec2(width, height);
+        _pyramidLevels = (int)std::floor(std::log2((float)std::max(width, height))) + 1;
+        _pyramidValid  = false;
+
+        glGenTextures(1, &_depthPyramid);
+        glBindTexture(GL_TEXTURE_2D, _depthPyramid);
+        glTexStorage2D(GL_TEXTURE_2D, _pyramidLevels, GL_R32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    // Instance bounds as center/extent structure of arrays, indexed by instance slot.
+    // Always padded to a multiple of 4 so the test loop can run on full SSE lanes.
+    std::vector<float> _centerX, _centerY, _centerZ;
+    std::vector<float> _extentX, _extentY, _extentZ;
+    std::vector<uint8_t> _visible;
+
+    // Grown as instances move, rebuilt only once membership or a static object changed.
+    // Between rebuilds it can be larger than the scene, never smaller
+    AM::AABB     _sceneBounds;
+    bool         _sceneBoundsDirty   = true;
+    unsigned int _sceneBoundsVersion = 0;
+
+    void SetInstanceBounds(unsigned int Slot, const AM::AABB& LocalBounds, const glm::mat4& Model)
+    {
+        if (Slot >= _centerX.size()) {
+            size_t size = (Slot + 4) & ~size_t(3);
+            for (auto* lane : { &_centerX, &_centerY, &_centerZ, &_extentX, &_extentY, &_extentZ })
+                lane->resize(std::max(size, lane->size() * 2), 0.0f);
+        }
+
+        glm::vec3 center = (LocalBounds.min + LocalBounds.max) * 0.5f;
+        glm::vec3 extent = (LocalBounds.max - LocalBounds.min) * 0.5f;
+
+        // Extents are projected onto the world axes through the absolute model matrix,
+        // gives the tightest world AABB that still contains the rotated box
+        glm::mat3 absModel(glm::abs(glm::vec3(Model[0])), glm::abs(glm::vec3(Model[1])), glm::abs(glm::vec3(Model[2])));
+        glm::vec3 worldCenter = glm::vec3(Model * glm::vec4(center, 1.0f));
+        glm::vec3 worldExtent = absModel * extent;
+
+        _centerX[Slot] = worldCenter.x;
+        _centerY[Slot] = worldCenter.y;
+        _centerZ[Slot] = worldCenter.z;
+        _extentX[Slot] = worldExtent.x;
+        _extentY[Slot] = worldExtent.y;
+        _extentZ[Slot] = worldExtent.z;
+
+        _sceneBounds.min = glm::min(_sceneBounds.min, worldCenter - worldExtent);
+        _sceneBounds.max = glm::max(_sceneBounds.max, worldCenter + worldExtent);
+    }
+
+    void GetInstanceBounds(unsigned int Slot, glm::vec3& Center, glm::vec3& Extent)
+    {
+        Center = glm::vec3(_centerX[Slot], _centerY[Slot], _centerZ[Slot]);
+        Extent = glm::vec3(_extentX[Slot], _extentY[Slot], _extentZ[Slot]);
+    }
+
+    AM::AABB SceneBounds()
+    {
+        if (_sceneBoundsDirty || _sceneBoundsVersion != SM::StaticVersion)
+        {
+            _sceneBounds = AM::AABB();
+            for (auto& [meshID, batch] : SM::DrawList)
+                for (SM::Object* object : batch.Objects)
+                {
+                    unsigned int slot = object->GetInstanceSlot();
+                    glm::vec3 center(_centerX[slot], _centerY[slot], _centerZ[slot]);
+                    glm::vec3 extent(_extentX[slot], _extentY[slot], _extentZ[slot]);
+                    _sceneBounds.min = glm::min(_sceneBounds.min, center - extent);
+                    _sceneBounds.max = glm::max(_sceneBounds.max, center + extent);
+                }
+            _sceneBoundsDirty   = false;
+            _sceneBoundsVersion = SM::StaticVersion;
+        }
+        return _sceneBounds;
+    }
+
+    // Gribb-Hartmann, planes point inwards and are left unnormalized
+    // since only the sign of the distance is used
+    void ExtractPlanes(const glm::mat4& m, glm::vec4 planes[6])
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+    }
+
+    void TestBounds(const glm::vec4 planes[6])
+    {
+        size_t count = _centerX.size();
+        _visible.resize(count);
+
+#ifdef CULLING_SSE
+        const __m128 zero = _mm_setzero_ps();
+
+        for (size_t i = 0; i < count; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(&_centerX[i]);
+            __m128 cy = _mm_loadu_ps(&_centerY[i]);
+            __m128 cz = _mm_loadu_ps(&_centerZ[i]);
+            __m128 ex = _mm_loadu_ps(&_extentX[i]);
+            __m128 ey = _mm_loadu_ps(&_extentY[i]);
+            __m128 ez = _mm_loadu_ps(&_extentZ[i]);
+
+            __m128 inside = _mm_cmpeq_ps(zero, zero);
+            for (int p = 0; p < 6; p++)
+            {
+                const glm::vec4& plane = planes[p];
+
+                // Signed distance of the center plus the box radius along the plane normal
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)),
+                                                 _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+                                      _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)),
+                                                 _mm_set1_ps(plane.w)));
+                __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::abs(plane.x))),
+                                                 _mm_mul_ps(ey, _mm_set1_ps(std::abs(plane.y)))),
+                                      _mm_mul_ps(ez, _mm_set1_ps(std::abs(plane.z))));
+
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+            }
+
+            int mask = _mm_movemask_ps(inside);
+            _visible[i + 0] = (mask >> 0) & 1;
+            _visible[i + 1] = (mask >> 1) & 1;
+            _visible[i + 2] = (mask >> 2) & 1;
+            _visible[i + 3] = (mask >> 3) & 1;
+        }
+#else
+        for (size_t i = 0; i < count; i++)
+        {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++)
+            {
+                const glm::vec4& plane = planes[p];
+                float d = _centerX[i] * plane.x + _centerY[i] * plane.y + _centerZ[i] * plane.z + plane.w;
+                float r = _extentX[i] * std::abs(plane.x) + _extentY[i] * std::abs(plane.y) + _extentZ[i] * std::abs(plane.z);
+                inside = d + r >= 0.0f;
+            }
+            _visible[i] = inside;
+        }
+#endif
+    }
+
+    void UpdateCameraTerms()
+    {
+        _cameraPosition = AM::EditorCam.Position;
+        _lodScale       = Engine::GetWindowSize().y / (2.0f * std::tan(glm::radians(AM::EditorCam.Fov) * 0.5f));
+    }
+
+    float MaxScale(const glm::mat4& model)
+    {
+        return std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    }
+
+    // Coarsest LOD whose error stays under LODErrorPixels on the camera. Distance is taken
+    // to the bounds rather than the center so nothing coarsens while the camera is inside it.
+    int SelectLOD(const AM::Mesh& mesh, unsigned int slot)
+    {
+        if (mesh.LODs.size() < 2) return 0;
+
+        float scale = MaxScale(SM::Instances[slot].Model);
+
+        glm::vec3 center(_centerX[slot], _centerY[slot], _centerZ[slot]);
+        glm::vec3 extent(_extentX[slot], _extentY[slot], _extentZ[slot]);
+        float distance = std::max(glm::length(center - _cameraPosition) - glm::length(extent), 0.1f);
+        float pixelsPerUnit = scale * _lodScale / distance;
+
+        int lod = 0;
+        while (lod + 1 < (int)mesh.LODs.size() && mesh.LODs[lod + 1].Error * pixelsPerUnit <= LODErrorPixels) lod++;
+        return lod;
+    }
+
+    // Sphere against the normalized frustum planes, then the normal cone: when the camera sits
+    // inside the cone's back side every triangle of the meshlet faces away from it.
+    // The cone is skipped for mirrored or non-uniformly scaled instances, it doesn't survive those.
+    bool MeshletVisible(const AM::Meshlet& meshlet, const glm::mat4& model, float scale, bool coneValid, const glm::vec4 planes[6])
+    {
+        glm::vec3 center = glm::vec3(model * glm::vec4(meshlet.Center, 1.0f));
+        float     radius = meshlet.Radius * scale;
+
+        for (int p = 0; p < 6; p++)
+            if (glm::dot(glm::vec3(planes[p]), center) + planes[p].w < -radius) return false;
+
+        if (!coneValid || meshlet.ConeCutoff >= 1.0f) return true;
+
+        glm::vec3 axis     = glm::normalize(glm::mat3(model) * meshlet.ConeAxis);
+        glm::vec3 toCenter = center - _cameraPosition;
+        return glm::dot(toCenter, axis) < meshlet.ConeCutoff * glm::length(toCenter) + radius;
+    }
+
+    bool ConeTestValid(const glm::mat4& model)
+    {
+        float x = glm::length(glm::vec3(model[0]));
+        float y = glm::length(glm::vec3(model[1]));
+        float z = glm::length(glm::vec3(model[2]));
+        float maxScale = std::max(x, std::max(y, z));
+        return maxScale - std::min(x, std::min(y, z)) <= 0.01f * maxScale && glm::determinant(glm::mat3(model)) > 0.0f;
+    }
+
+    // Meshlets are contiguous in the index buffer, neighbouring survivors merge into one range.
+    // All ranges of the instance share a single draw index. Returns false if nothing survived.
+    bool CullClustersCPU(View& view, const AM::Mesh& mesh, unsigned int slot, const glm::vec4 planes[6])
+    {
+        const glm::mat4& model = SM::Instances[slot].Model;
+        float scale     = MaxScale(model);
+        bool  coneValid = ConeTestValid(model);
+
+        SM::DrawElementsIndirectCommand cmd = { 0, 1, 0, (int)mesh.BaseVertex, (unsigned int)view.DrawIndices.size() };
+        size_t firstCommand = view.Commands.size();
+
+        auto flush = [&]() {
+            if (cmd.Count == 0) return;
+            view.Commands.push_back(cmd);
+            view.Triangles += cmd.Count / 3;
+        };
+
+        for (const AM::Meshlet& meshlet : mesh.Meshlets)
+        {
+            view.ClusterTriangles += meshlet.IndexCount / 3;
+            if (!MeshletVisible(meshlet, model, scale, coneValid, planes)) {
+                view.ClusterRejected += meshlet.IndexCount / 3;
+                continue;
+            }
+
+            if (cmd.Count > 0 && cmd.FirstIndex + cmd.Count == meshlet.FirstIndex) {
+                cmd.Count += meshlet.IndexCount;
+                continue;
+            }
+            flush();
+            cmd.FirstIndex = meshlet.FirstIndex;
+            cmd.Count      = meshlet.IndexCount;
+        }
+        flush();
+
+        if (view.Commands.size() == firstCommand) return false;
+        view.DrawIndices.push_back(slot);
+        return true;
+    }
+
+    bool DrawsCaster(ViewID ID, bool Dynamic)
+    {
+        switch (ViewCasters[ID]) {
+            case AllCasters:     return true;
+            case StaticCasters:  return !Dynamic;
+            case DynamicCasters: return Dynamic;
+
+            default: return false;
+        }
+    }
+
+    void BeginView(View& view)
+    {
+        if (view.DrawIndexSSBO == 0) {
+            glGenBuffers(1, &view.DrawIndexSSBO);
+            glGenBuffers(1, &view.DrawCommandBuffer);
+        }
+
+        view.Commands.clear();
+        view.DrawIndices.clear();
+        view.Visible          = 0;
+        view.Culled           = 0;
+        view.Triangles        = 0;
+        view.ClusterTriangles = 0;
+        view.ClusterRejected  = 0;
+    }
+
+    // One command per LOD in use, each with its own run of draw indices
+    void EmitLODCommands(View& view, const AM::Mesh& mesh)
+    {
+        for (int lod = 0; lod < (int)mesh.LODs.size(); lod++)
+        {
+            if (_lodSlots[lod].empty()) continue;
+
+            SM::DrawElementsIndirectCommand cmd;
+            cmd.Count         = mesh.LODs[lod].IndexCount;
+            cmd.InstanceCount = _lodSlots[lod].size();
+            cmd.FirstIndex    = mesh.LODs[lod].FirstIndex;
+            cmd.BaseVertex    = mesh.BaseVertex;
+            cmd.BaseInstance  = view.DrawIndices.size();
+            view.Commands.push_back(cmd);
+
+            view.DrawIndices.insert(view.DrawIndices.end(), _lodSlots[lod].begin(), _lodSlots[lod].end());
+            view.Triangles += (long long)(cmd.Count / 3) * cmd.InstanceCount;
+        }
+    }
+
+    void UploadView(const View& view)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, view.DrawIndexSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, view.DrawIndices.size() * sizeof(unsigned int), view.DrawIndices.data(), GL_STREAM_DRAW);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, view.DrawCommandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, view.Commands.size() * sizeof(SM::DrawElementsIndirectCommand), view.Commands.data(), GL_STREAM_DRAW);
+    }
+
+    void CullViewCPU(ViewID ID, const glm::mat4& ViewProj)
+    {
+        View& view = Views[ID];
+        BeginView(view);
+
+        bool skip = ViewCasters[ID] == NoCasters;
+        bool test = CullingMode == Mode::CPU && !skip;
+        glm::vec4 planes[6];
+        if (test) {
+            ExtractPlanes(ViewProj, planes);
+            TestBounds(planes);
+
+            // Spheres need real distances
+            for (glm::vec4& plane : planes) plane /= glm::length(glm::vec3(plane));
+        }
+        bool clusters = test && ClusterCulling && ID == CameraView;
+
+        // Layered cascades only record their mask, BuildShadowsCPU draws them
+        bool layered = LayeredShadows && ID >= Cascade0 && ID <= Cascade2;
+        uint8_t layerBit = layered ? 1 << (ID - Cascade0) : 0;
+
+        for (auto& [meshID, batch] : SM::DrawList)
+        {
+            const AM::Mesh& mesh = AM::Meshes.at(meshID);
+            if (skip || batch.Objects.empty() || mesh.IndexCount == 0) continue;
+
+            int lodCount = mesh.LODs.size();
+            for (int lod = 0; lod < lodCount; lod++) _lodSlots[lod].clear();
+
+            unsigned int visible = 0;
+            for (SM::Object* object : batch.Objects)
+            {
+                unsigned int slot = object->GetInstanceSlot();
+                if (!DrawsCaster(ID, object->IsDynamic())) continue;
+                if (test && !_visible[slot]) continue;
+
+                if (layered) {
+                    _cascadeMasks[slot] |= layerBit;
+                    visible++;
+                    continue;
+                }
+
+                int lod = std::min(SelectLOD(mesh, slot) + LODBias[ID], lodCount - 1);
+                if (clusters && lod == 0 && !mesh.Meshlets.empty()) {
+                    visible += CullClustersCPU(view, mesh, slot, planes);
+                    continue;
+                }
+
+                _lodSlots[lod].push_back(slot);
+                visible++;
+            }
+
+            view.Visible += visible;
+            view.Culled  += batch.Objects.size() - visible;
+
+            EmitLODCommands(view, mesh);
+        }
+
+        UploadView(view);
+    }
+
+    // Merges the cascade masks recorded by CullViewCPU into the Shadows view
+    void BuildShadowsCPU()
+    {
+        View& view = Views[Shadows];
+        BeginView(view);
+
+        for (auto& [meshID, batch] : SM::DrawList)
+        {
+            const AM::Mesh& mesh = AM::Meshes.at(meshID);
+            if (!LayeredShadows || batch.Objects.empty() || mesh.IndexCount == 0) continue;
+
+            int lodCount = mesh.LODs.size();
+            for (int lod = 0; lod < lodCount; lod++) _lodSlots[lod].clear();
+
+            for (SM::Object* object : batch.Objects)
+            {
+                unsigned int slot = object->GetInstanceSlot();
+                unsigned int mask = _cascadeMasks[slot];
+                if (mask == 0) continue;
+
+                int lod     = SelectLOD(mesh, slot);
+                int maskLod = lodCount - 1;
+                for (int c = 0; c < 3; c++)
+                {
+                    if (!(mask & (1u << c))) continue;
+
+                    int cascadeLod = std::min(lod + LODBias[Cascade0 + c], lodCount - 1);
+                    if (LayerMasks) {
+                        maskLod = std::min(maskLod, cascadeLod);
+                        continue;
+                    }
+                    _lodSlots[cascadeLod].push_back(slot | ((1u << c) << CASCADE_MASK_SHIFT));
+                    view.Visible++;
+                }
+
+                if (LayerMasks) {
+                    _lodSlots[maskLod].push_back(slot | (mask << CASCADE_MASK_SHIFT));
+                    view.Visible++;
+                }
+            }
+
+            EmitLODCommands(view, mesh);
+        }
+
+        UploadView(view);
+    }
+
+    size_t StatsSize()
+    {
+        return COUNTERS_SIZE + NumViews * _groupCount * sizeof(SM::DrawElementsIndirectCommand);
+    }
+
+    void SetInstanceBatch(unsigned int Slot, unsigned int Batch, bool Dynamic)
+    {
+        if (Slot >= _instanceBatch.size()) _instanceBatch.resize(Slot + 1, UINT32_MAX);
+
+        unsigned int& entry = _instanceBatch[Slot];
+        if (entry == UINT32_MAX && Batch != UINT32_MAX) _instanceCount++;
+        if (entry != UINT32_MAX && Batch == UINT32_MAX) _instanceCount--;
+        entry = Batch == UINT32_MAX ? UINT32_MAX : Batch | (Dynamic ? DYNAMIC_INSTANCE_BIT : 0u);
+
+        _instanceBatchDirtyBegin = std::min(_instanceBatchDirtyBegin, (size_t)Slot);
+        _instanceBatchDirtyEnd   = std::max(_instanceBatchDirtyEnd,   (size_t)Slot + 1);
+    }
+
+    void UploadInstanceBatches()
+    {
+        size_t count = _instanceBatch.size();
+
+        if (count > _slotCapacity) {
+            _slotCapacity = std::max(count, _slotCapacity * 2);
+
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, _instanceBatchSSBO);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, _slotCapacity * sizeof(unsigned int), nullptr, GL_DYNAMIC_DRAW);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(unsigned int), _instanceBatch.data());
+
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, _occludedSSBO);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, _slotCapacity * sizeof(unsigned int), nullptr, GL_DYNAMIC_COPY);
+        }
+        else if (_instanceBatchDirtyBegin < std::min(_instanceBatchDirtyEnd, count)) {
+            size_t end = std::min(_instanceBatchDirtyEnd, count);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, _instanceBatchSSBO);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                            _instanceBatchDirtyBegin * sizeof(unsigned int),
+                            (end - _instanceBatchDirtyBegin) * sizeof(unsigned int),
+                            _instanceBatch.data() + _instanceBatchDirtyBegin);
+        }
+
+        _slotCount = count;
+        _instanceBatchDirtyBegin = SIZE_MAX;
+        _instanceBatchDirtyEnd   = 0;
+    }
+
+    void UploadBatches()
+    {
+        _sceneBoundsDirty = true;
+
+        std::vector<BatchData> batches(SM::DrawCommands.size());
+        std::vector<GroupData> groups;
+        std::vector<MeshletData> meshlets;
+        unsigned int baseInstance  = 0;
+        unsigned int instanceCount = 0;
+
+        _instanceBatch.assign(SM::Instances.size(), UINT32_MAX);
+        _instanceBatchDirtyBegin = 0;
+        _instanceBatchDirtyEnd   = _instanceBatch.size();
+
+        for (auto& [meshID, batch] : SM::DrawList)
+        {
+            const AM::Mesh& mesh = AM::Meshes.at(meshID);
+            if (batch.Command == UINT32_MAX) continue;
+
+            BatchData data = {};
+            data.Center     = glm::vec4((mesh.aabb.min + mesh.aabb.max) * 0.5f, 0.0f);
+            data.Extent     = glm::vec4((mesh.aabb.max - mesh.aabb.min) * 0.5f, 0.0f);
+            data.FirstGroup = groups.size();
+            data.LODCount   = mesh.LODs.size();
+
+            // Every LOD has room for the batch's whole run, an instance lands in exactly one of them per view
+            for (const AM::MeshLOD& lod : mesh.LODs) {
+                groups.push_back({ lod.IndexCount, lod.FirstIndex, (int)mesh.BaseVertex, baseInstance, lod.Error });
+                baseInstance += batch.RunCapacity;
+            }
+
+            data.FirstMeshlet = meshlets.size();
+            data.MeshletCount = mesh.Meshlets.size();
+            for (const AM::Meshlet& meshlet : mesh.Meshlets) {
+                MeshletData m = {};
+                m.Sphere     = glm::vec4(meshlet.Center, meshlet.Radius);
+                m.Cone       = glm::vec4(meshlet.ConeAxis, meshlet.ConeCutoff);
+                m.FirstIndex = meshlet.FirstIndex;
+                m.IndexCount = meshlet.IndexCount;
+                meshlets.push_back(m);
+            }
+
+            for (SM::Object* object : batch.Objects)
+                _instanceBatch[object->GetInstanceSlot()] = batch.Command | (object->IsDynamic() ? DYNAMIC_INSTANCE_BIT : 0u);
+
+            instanceCount += batch.Objects.size();
+            batches[batch.Command] = data;
+        }
+
+        _batchCount     = batches.size();
+        _groupCount     = groups.size();
+        _instanceCount  = instanceCount;
+        _instanceStride = baseInstance;
+        _meshletCount   = meshlets.size();
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _batchSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, batches.size() * sizeof(BatchData), batches.data(), GL_DYNAMIC_DRAW);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _groupSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, groups.size() * sizeof(GroupData), groups.data(), GL_DYNAMIC_DRAW);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _meshletSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, meshlets.size() * sizeof(MeshletData), meshlets.data(), GL_DYNAMIC_DRAW);
+
+        // Every view gets room for all groups and all instances, filled on the GPU
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _commandSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, NumViews * _groupCount * sizeof(SM::DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_COPY);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _compactedBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, NumViews * _groupCount * sizeof(SM::DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_COPY);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _drawIndexSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (VIEW_STRIDES * _instanceStride + 2 * CLUSTER_BUDGET) * sizeof(unsigned int), nullptr, GL_DYNAMIC_COPY);
+
+        // Counters followed by the compacted commands of every view, a pending copy has the old layout
+        if (_statsFence) {
+            glDeleteSync(_statsFence);
+            _statsFence = nullptr;
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, _statsBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, StatsSize(), nullptr, GL_STREAM_READ);
+    }
+
+    // Counters are copied aside after culling and only read once the fence has
+    // passed, so the overlay never waits on the GPU
+    void ReadGPUStats()
+    {
+        if (!_statsFence) return;
+
+        GLenum status = glClientWaitSync(_statsFence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+
+        glDeleteSync(_statsFence);
+        _statsFence = nullptr;
+
+        unsigned int counters[COUNTERS_SIZE / sizeof(unsigned int)];
+        std::vector<SM::DrawElementsIndirectCommand> commands(NumViews * _groupCount);
+        glBindBuffer(GL_COPY_READ_BUFFER, _statsBuffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(counters), counters);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, sizeof(counters), commands.size() * sizeof(SM::DrawElementsIndirectCommand), commands.data());
+
+        for (int i = 0; i < NumViews; i++) {
+            Views[i].Visible   = counters[NumViews + i];
+            Views[i].Culled    = std::max(0, (int)_instanceCount - Views[i].Visible);
+            Views[i].Triangles = 0;
+
+            for (unsigned int c = 0; c < std::min(counters[i], _groupCount); c++) {
+                const SM::DrawElementsIndirectCommand& cmd = commands[i * _groupCount + c];
+                Views[i].Triangles += (long long)(cmd.Count / 3) * cmd.InstanceCount;
+            }
+        }
+
+        // Late survivors are drawn into the camera view too, they only count once there
+        Views[CameraView].Visible   += Views[CameraLate].Visible;
+        Views[CameraView].Culled    -= std::min(Views[CameraView].Culled, Views[CameraLate].Visible);
+        Views[CameraView].Triangles += Views[CameraLate].Triangles;
+
+        // Cluster draws are one instance each, only counted through their triangles
+        unsigned int clusterTriangles = counters[NumViews * 2 + 2];
+        unsigned int clusterRejected  = counters[NumViews * 2 + 3];
+        Views[CameraView].ClusterTriangles = clusterTriangles;
+        Views[CameraView].ClusterRejected  = clusterRejected;
+        Views[CameraView].Triangles       += clusterTriangles - clusterRejected;
+        Views[CameraLate].Culled     = 0;
+
+        // Counts instance and cascade pairs, nothing is culled from it directly
+        Views[Shadows].Culled = 0;
+    }
+
+    void CopyGPUStats()
+    {
+        if (_statsFence) return;
+
+        glBindBuffer(GL_COPY_READ_BUFFER,  _counterBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, _statsBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, COUNTERS_SIZE);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, _compactedBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, COUNTERS_SIZE, StatsSize() - COUNTERS_SIZE);
+        _statsFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    void BindCullingBuffers()
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, SM::InstanceSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _batchSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, _instanceBatchSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, _commandSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, _compactedBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, _counterBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, _drawIndexSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, _occludedSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, _groupSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, _meshletSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, _clusterCommandBuffer);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, _depthPyramid);
+    }
+
+    void CullViewsGPU(const glm::mat4 ViewProj[NumViews])
+    {
+        ReadGPUStats();
+        if (_batchCount == 0) return;
+
+        BindCullingBuffers();
+        _cameraViewProj = ViewProj[CameraView];
+
+        unsigned int commandGroups = (NumViews * _groupCount + 63) / 64;
+
+        S_reset->Use();
+        S_reset->SetInt("groupCount", _groupCount);
+        S_reset->SetInt("instanceStride", _instanceStride);
+        glDispatchCompute(commandGroups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        S_cull->Use();
+        S_cull->SetInt("depthPyramid", 0);
+        S_cull->SetInt("slotCount", _slotCount);
+        S_cull->SetInt("groupCount", _groupCount);
+        S_cull->SetBool("latePhase", false);
+        S_cull->SetBool("pyramidValid", OcclusionCulling && _pyramidValid);
+        S_cull->SetMatrix4("pyramidViewProj", _pyramidViewProj);
+        S_cull->SetVector3("cameraPosition", _cameraPosition);
+        S_cull->SetFloat("lodScale", _lodScale);
+        S_cull->SetFloat("lodErrorPixels", LODErrorPixels);
+        S_cull->SetBool("clusterCulling", ClusterCulling && _meshletCount > 0);
+        S_cull->SetInt("clusterBudget", CLUSTER_BUDGET);
+        S_cull->SetInt("clusterIndexBase", VIEW_STRIDES * _instanceStride);
+        S_cull->SetBool("layeredShadows", LayeredShadows);
+        S_cull->SetBool("layerMasks", LayerMasks);
+
+        int       casters[NumViews];
+        glm::vec4 planes[NumViews * 6];
+        for (int i = 0; i < NumViews; i++)
+        {
+            casters[i] = ViewCasters[i];
+            ExtractPlanes(ViewProj[i], planes + i * 6);
+        }
+        S_cull->SetIntArray("lodBias", LODBias, NumViews);
+        S_cull->SetIntArray("casters", casters, NumViews);
+        S_cull->SetVector4Array("planes", planes, NumViews * 6);
+        glDispatchCompute((_slotCount + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        S_compact->Use();
+        S_compact->SetInt("groupCount", _groupCount);
+        S_compact->SetInt("firstView", 0);
+        glDispatchCompute(commandGroups, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    }
+
+    void BuildDepthPyramid(unsigned int DepthTexture)
+    {
+        // Follows the depth buffer, which dynamic resolution keeps below the window size
+        glm::ivec2 depthSize;
+        glGetTextureLevelParameteriv(DepthTexture, 0, GL_TEXTURE_WIDTH,  &depthSize.x);
+        glGetTextureLevelParameteriv(DepthTexture, 0, GL_TEXTURE_HEIGHT, &depthSize.y);
+        if (depthSize != _pyramidSize) Resize(depthSize.x, depthSize.y);
+
+        S_depthPyramid->Use();
+        S_depthPyramid->SetInt("depth", 0);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, DepthTexture);
+
+        glm::ivec2 size = _pyramidSize;
+        for (int level = 0; level < _pyramidLevels; level++)
+        {
+            S_depthPyramid->SetInt("level", level);
+            if (level > 0) glBindImageTexture(0, _depthPyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glBindImageTexture(1, _depthPyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+            glDispatchCompute((size.x + 7) / 8, (size.y + 7) / 8, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+            size = glm::max(size / 2, glm::ivec2(1));
+        }
+
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        _pyramidViewProj = _cameraViewProj;
+        _pyramidValid    = true;
+    }
+
+    void CullLate(unsigned int DepthTexture)
+    {
+        if (CullingMode != Mode::GPU) {
+            _pyramidValid = false;
+            return;
+        }
+        if (_batchCount == 0) return;
+
+        if (OcclusionCulling) {
+            BuildDepthPyramid(DepthTexture);
+            BindCullingBuffers();
+
+            S_cull->Use();
+            S_cull->SetInt("depthPyramid", 0);
+            S_cull->SetBool("latePhase", true);
+            S_cull->SetMatrix4("pyramidViewProj", _pyramidViewProj);
+            glDispatchCompute((_slotCount + 63) / 64, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+            S_compact->Use();
+            S_compact->SetInt("firstView", CameraLate);
+            glDispatchCompute((_groupCount + 63) / 64, 1, 1);
+            glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        }
+        else _pyramidValid = false;
+
+        CopyGPUStats();
+    }
+
+    void CullViews(const glm::mat4 ViewProj[NumViews])
+    {
+        UpdateCameraTerms();
+
+        if (CullingMode == Mode::GPU) {
+            CullViewsGPU(ViewProj);
+            return;
+        }
+
+        _cascadeMasks.assign(SM::Instances.size(), 0);
+        for (int i = 0; i < CameraLate; i++)
+            if (i != Shadows) CullViewCPU(ViewID(i), ViewProj[i]);
+        BuildShadowsCPU();
+
+        Views[CameraLate].Visible   = 0;
+        Views[CameraLate].Triangles = 0;
+    }
+
+    void WaitForGPUStats()
+    {
+        if (CullingMode != Mode::GPU || _batchCount == 0) return;
+
+        CopyGPUStats();
+        while (glClientWaitSync(_statsFence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED);
+        ReadGPUStats();
+    }
+
+    void DrawView(ViewID ID)
+    {
+        const size_t commandSize = sizeof(SM::DrawElementsIndirectCommand);
+
+        // Survivor count never leaves the GPU, the draw count is sourced from the counter buffer
+        if (CullingMode == Mode::GPU) {
+            if (_batchCount == 0) return;
+
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _drawIndexSSBO);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _compactedBuffer);
+            glBindBuffer(GL_PARAMETER_BUFFER, _counterBuffer);
+            glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                             (const void*)(ID * _groupCount * commandSize),
+                                             ID * sizeof(unsigned int), _groupCount, 0);
+
+            // Meshlet ranges of the camera phases, counted at clusterDrawCount[phase]
+            if ((ID == CameraView || ID == CameraLate) && ClusterCulling && _meshletCount > 0) {
+                unsigned int phase = ID == CameraLate;
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _clusterCommandBuffer);
+                glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                                 (const void*)(phase * CLUSTER_BUDGET * commandSize),
+                                                 (NumViews * 2 + phase) * sizeof(unsigned int), CLUSTER_BUDGET, 0);
+            }
+            return;
+        }
+
+        const View& view = Views[ID];
+        if (view.Commands.empty()) return;
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, view.DrawIndexSSBO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, view.DrawCommandBuffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, view.Commands.size(), 0);
+    }
+
+    const char* ViewToString(ViewID ID)
+    {
+        switch (ID) {
+            case CameraView:    return "Camera";
+            case Cascade0:      return "Cascade 0";
+            case Cascade1:      return "Cascade 1";
+            case Cascade2:      return "Cascade 2";
+            case CascadeStatic: return "Cascade cache";
+            case Shadows:       return "Shadows";
+            case CameraLate:    return "Camera (late)";
+
+            default: return "Unknown";
+        }
+    }
+
+    const char* ModeToString(Mode Mode)
+    {
+        switch (Mode) {
+            case Disabled: return "Disabled";
+            case CPU:      return "CPU";
+            case GPU:      return "GPU";
+
+            default: return "Unknown";
+        }
+    }
+
+    void ReloadShaders()
+    {
+        S_reset->Reload();
+        S_cull->Reload();
+        S_compact->Reload();
+        S_depthPyramid->Reload();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../asset_manager.h"
+#include "../scene_manager.h"
+
+namespace Culling
+{
+    // Every view gets its own compacted draw lists, cascades follow the camera.
+    // CascadeStatic is the cascade whose cached static layer is rebuilt this frame.
+    // Shadows merges the cascades into one layered draw, see LayeredShadows.
+    // CameraLate holds what the GPU path only found visible after the depth pyramid rebuild.
+    enum ViewID
+    {
+        CameraView    = 0,
+        Cascade0      = 1,
+        Cascade1      = 2,
+        Cascade2      = 3,
+        CascadeStatic = 4,
+        Shadows       = 5,
+        CameraLate    = 6,
+        NumViews      = 7,
+    };
+
+    enum Mode
+    {
+        Disabled = 0,
+        CPU      = 1,
+        GPU      = 2,
+    };
+    inline Mode CullingMode = Mode::GPU;
+
+    // Hi-Z test of the camera view, GPU mode only
+    inline bool OcclusionCulling = true;
+
+    // Coarsest LOD whose simplification error projects to at most this many pixels on
+    // the camera. Views add their bias on top, shadow cascades get away with less detail.
+    inline float LODErrorPixels    = 1.0f;
+    inline int   LODBias[NumViews] = { 0, 0, 1, 2, 0, 0, 0 };
+
+    // Which objects a view draws, set per frame by the shadow cache
+    enum Casters
+    {
+        AllCasters     = 0,
+        StaticCasters  = 1,
+        DynamicCasters = 2,
+        NoCasters      = 3,
+    };
+    inline Casters ViewCasters[NumViews] = { AllCasters, AllCasters, AllCasters, AllCasters, NoCasters, NoCasters, AllCasters };
+
+    // Cascade survivors go to the Shadows view instead of their own, tagged with the cascades
+    // they overlap in the top bits of their draw index, and all layers are drawn in one pass.
+    // With LayerMasks every instance gets a single entry with its whole mask at the finest
+    // LOD it needs, for drivers that can only route to layers from a geometry shader.
+    // Without it there is one entry per cascade and the vertex shader picks the layer.
+    inline bool LayeredShadows = true;
+    inline bool LayerMasks     = false;
+
+    // Meshlets of camera instances drawn at LOD 0 are tested on their own against
+    // the frustum and their normal cone, survivors are drawn as separate ranges
+    inline bool ClusterCulling = true;
+
+    struct View
+    {
+        // Same batch order as SM::DrawCommands with one command per LOD in use,
+        // batches with nothing visible are dropped
+        std::vector<SM::DrawElementsIndirectCommand> Commands;
+        std::vector<unsigned int> DrawIndices;
+
+        unsigned int DrawIndexSSBO     = 0;
+        unsigned int DrawCommandBuffer = 0;
+
+        // In GPU mode these lag a frame or two behind, read back without stalling
+        int Visible = 0;
+        int Culled  = 0;
+        long long Triangles = 0;
+
+        // Triangles of the meshlets tested by cluster culling and how many of them were rejected
+        long long ClusterTriangles = 0;
+        long long ClusterRejected  = 0;
+    };
+    inline View Views[NumViews];
+
+    // Matches the std430 layout of the Batches SSBO (binding 2)
+    struct BatchData
+    {
+        glm::vec4    Center;
+        glm::vec4    Extent;
+        unsigned int FirstGroup;
+        unsigned int LODCount;
+        unsigned int FirstMeshlet;
+        unsigned int MeshletCount;
+    };
+
+    // One draw command template per LOD of every batch, Groups SSBO (binding 9)
+    struct GroupData
+    {
+        unsigned int Count;
+        unsigned int FirstIndex;
+        int          BaseVertex;
+        unsigned int BaseInstance;
+        float        Error;
+    };
+
+    // Meshlets SSBO (binding 10), object space sphere and normal cone
+    struct MeshletData
+    {
+        glm::vec4    Sphere;
+        glm::vec4    Cone;
+        unsigned int FirstIndex;
+        unsigned int IndexCount;
+        unsigned int Padding[2];
+    };
+
+    void Initialize();
+
+    // World-space bounds of the instance in the given slot, kept in sync by SM
+    void SetInstanceBounds(unsigned int Slot, const AM::AABB& LocalBounds, const glm::mat4& Model);
+    void GetInstanceBounds(unsigned int Slot, glm::vec3& Center, glm::vec3& Extent);
+
+    // Union of the world-space bounds of everything in the DrawList, empty if nothing is.
+    // Cached, may stay conservatively large after dynamic objects move until the next rebuild
+    AM::AABB SceneBounds();
+
+    // Uploads batch bounds, LOD groups and meshlets for the GPU path, only called when
+    // SM::RebuildDrawCommands lays the batches out anew. Group runs follow the batch runs
+    void UploadBatches();
+
+    // Culling batch of an instance slot, UINT32_MAX once it left the DrawList. Patched
+    // between layouts and flushed by UploadInstanceBatches
+    void SetInstanceBatch(unsigned int Slot, unsigned int Batch, bool Dynamic);
+    void UploadInstanceBatches();
+
+    // Tests every instance against the frustum of each view and fills the view's draw lists
+    void CullViews(const glm::mat4 ViewProj[NumViews]);
+
+    // Second occlusion phase, must follow the CameraView draw. Builds the depth pyramid from
+    // DepthTexture and re-tests everything the early phase rejected, survivors go to CameraLate.
+    void CullLate(unsigned int DepthTexture);
+
+    // Waits for the counters of the last GPU cull and reads them into Views,
+    // for tests and tools that can't wait the frame or two they usually lag
+    void WaitForGPUStats();
+
+    // Issues the multi-draw for a view, expects SM::BindDrawBuffers to be bound
+    void DrawView(ViewID ID);
+
+    const char* ViewToString(ViewID ID);
+    const char* ModeToString(Mode Mode);
+}
\ No newline at end of file
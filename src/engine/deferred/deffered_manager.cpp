@@ -1,6 +1,9 @@
 #include <iostream>
 #include <memory>
 #include <format>
+#include <cmath>
+#include <limits>
+#include <algorithm>
 
 #include <glm/glm.hpp>
 #include <glad/glad.h>
@@ -10,6 +13,9 @@
 #include "../render_engine.h"
 #include "../asset_manager.h"
 #include "../scene_manager.h"
+#include "../culling/culling.h"
+#include "../lighting/lighting.h"
+#include "../lighting/ambient_occlusion.h"
 #include "../../common/shader.h"
 #include "../../common/qk.h"
 #include "../../ui/text_renderer.h"
@@ -17,20 +23,112 @@
 namespace Deferred
 {
     void Resize(int width, int height);
+    void Allocate();
     void ReloadShaders();
     void CheckFBOStatus(std::string FBOName);
 
     unsigned int gbufferFBO;
     unsigned int defferedQuadVAO;
+
+    // Window size from the resize callback and the RenderScale of it the G-buffers are allocated at
+    glm::ivec2 windowSize;
+    glm::ivec2 renderSize;
+
+    // Dynamic resolution controller. Over budget the scale drops straight to the estimated fit,
+    // under HEADROOM of the budget for UPSCALE_FRAMES it grows a step, in between it holds.
+    // Every change waits SETTLE_FRAMES for the lagging GPU timers to catch up.
+    const float SCALE_STEP     = 0.05f;
+    const float HEADROOM       = 0.8f;
+    const int   SETTLE_FRAMES  = 30;
+    const int   UPSCALE_FRAMES = 60;
+    float smoothedGpuMs     = 0.0f;
+    int   framesSinceChange = 0;
+    int   framesUnderBudget = 0;
     std::unique_ptr<Shader> S_fullscreenQuad;
+
+    // Resolved frames, ResolveTemporal reads one and writes the other. Window sized, so a
+    // render scale change keeps them and only the jitter spacing follows the new size
+    unsigned int taaHistory[2];
+    glm::ivec2   historySize(0);
+    int          historyIndex = 0;
+    bool         historyValid = false;
+    unsigned int temporalFrame = 0;
+
+    // Nearest masked pixel per render pixel, ping-ponged by the jump flood passes. Only the
+    // render pixels in [outlineMin, outlineMax) are written each frame, the rest is stale
+    unsigned int outlineSeeds[2];
+    int          outlineField = 0;
+    glm::ivec2   outlineMin(0);
+    glm::ivec2   outlineMax(0);
+
+    // In window pixels, like the 32-tap ring it replaced
+    const float OUTLINE_WIDTH = 2.5f;
+
+    // Camera of the last upload, without jitter, for the velocity of the next frame
+    glm::mat4 prevViewProjection(1.0f);
+    glm::vec2 prevJitter(0.0f);
+    bool      hasPrevFrame = false;
     
     unsigned int dirShadowMapFBO;
     const int NUM_CASCADES   = 3;
     const int SHADOW_MAP_RES = 2048;
-    float cascadeSplits[NUM_CASCADES] = { 10.0f, 25.0f, 55.0f };
+    float cascadeSplits[NUM_CASCADES];
     glm::mat4 lightSpaceMatrices[NUM_CASCADES];
     unsigned int DirCascades;
 
+    // Horizontal pass of the shadow factor blur, full resolution in ShadowBlurred only
+    unsigned int shadowBlurScratch;
+
+    // Shadow cache, static casters only. Copied into DirCascades before the dynamic casters are drawn.
+    unsigned int DirCascadesStatic;
+
+    enum class CascadeUpdate
+    {
+        Skip,    // Cache valid, DirCascades still holds the last frame it was drawn
+        Cached,  // Copy the static layer, draw dynamic casters on top
+        Rebuild, // Redraw the static layer first, then as Cached
+        Full,    // Everything straight into DirCascades, the static layer stays invalid
+    };
+
+    // Light space fit of a cascade. The slice's bounding sphere only depends on the split
+    // distances and the projection, so the square it maps to keeps its size under camera
+    // rotation and its center moves in whole texels.
+    struct CascadeCache
+    {
+        glm::vec2 Center;     // Snapped to the texel grid
+        float     Radius = 0; // Bounding sphere of the slice
+        float     Extent = 0; // Half size of the square, padded
+        float     NearZ  = 0; // Light space depth range, from the scene bounds
+        float     FarZ   = 0;
+        bool      Fitted      = false;
+        bool      StaticValid = false;
+        unsigned int StaticVersion = 0;
+        int          LastDrawn     = 0;
+        CascadeUpdate Update = CascadeUpdate::Full;
+    };
+    CascadeCache cascadeCaches[NUM_CASCADES];
+    int rebuildCascade = -1;
+    int shadowFrame    = 0;
+
+    // Matches the std140 Frame block in res/shaders/common/frame.glsl
+    struct FrameUniforms
+    {
+        glm::mat4 View;
+        glm::mat4 Projection;
+        glm::mat4 InvProjection;
+        glm::mat4 InvView;
+        glm::vec3 CameraPosition;
+        float     Padding0;
+        glm::vec3 CameraDirection;
+        float     Padding1;
+        glm::mat4 LightSpaceMatrices[NUM_CASCADES];
+        glm::vec4 CascadeSplits;
+        glm::mat4 ViewProjection;
+        glm::mat4 PrevViewProjection;
+        glm::vec4 Jitter;
+    };
+    unsigned int frameUBO;
+
     unsigned int screenQuadVAO, screenQuadVBO;
     std::unique_ptr<Shader> S_texture, S_texturea;
 
@@ -72,6 +170,13 @@ namespace Deferred
         glBindTexture(GL_TEXTURE_2D, GBuffers[GDirShadowFactor]);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D, GBuffers[GDirShadowFactor], 0);
 
+        // Velocity
+        glGenTextures(1, &GBuffers[GVelocity]);
+
+        glGenTextures(1, &shadowBlurScratch);
+        glGenTextures(2, taaHistory);
+        glGenTextures(2, outlineSeeds);
+
         Resize(Engine::GetWindowSize().x, Engine::GetWindowSize().y);
 
         CheckFBOStatus("Deferred");
@@ -99,6 +204,18 @@ namespace Deferred
         constexpr float bordercolor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
         glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, bordercolor);
             
+        // Only ever rendered to and copied from
+        glGenTextures(1, &DirCascadesStatic);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, DirCascadesStatic);
+        glTexImage3D( GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24,
+            SHADOW_MAP_RES,
+            SHADOW_MAP_RES,
+            NUM_CASCADES,
+            0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
         glBindFramebuffer(GL_FRAMEBUFFER, dirShadowMapFBO);
         glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, DirCascades, 0);
         glDrawBuffer(GL_NONE);
@@ -108,13 +225,28 @@ namespace Deferred
 
         S_GBuffers   = std::make_unique<Shader>("/res/shaders/deferred/draw_gbuffers");
         S_shading    = std::make_unique<Shader>("/res/shaders/deferred/shading");
+        S_shadingTiled = std::make_unique<Shader>("/res/shaders/deferred/shading_tiled");
         S_shadow     = std::make_unique<Shader>("/res/shaders/deferred/shadow");
+        // gl_Layer in the vertex shader needs ARB_shader_viewport_layer_array,
+        // without it a geometry shader fans the cascade masks out instead
+        Culling::LayerMasks = !GLAD_GL_ARB_shader_viewport_layer_array;
+        S_shadowLayered = std::make_unique<Shader>(Culling::LayerMasks ? "/res/shaders/deferred/shadow_layered_gs"
+                                                                       : "/res/shaders/deferred/shadow_layered");
         S_shadowCalc = std::make_unique<Shader>("/res/shaders/deferred/shadowcalc");
+        S_shadowBlur = std::make_unique<Shader>("/res/shaders/deferred/shadow_blur");
         S_mask       = std::make_unique<Shader>("/res/shaders/deferred/mask");
         S_texture    = std::make_unique<Shader>("/res/shaders/deferred/texture");
         S_texturea   = std::make_unique<Shader>("/res/shaders/deferred/texturea");
         S_fullscreenQuad  = std::make_unique<Shader>("/res/shaders/deferred/texture_fullscreen");
         S_postprocessQuad = std::make_unique<Shader>("/res/shaders/deferred/postprocess");
+        S_taa        = std::make_unique<Shader>("/res/shaders/deferred/taa");
+        S_outlineJFA = std::make_unique<Shader>("/res/shaders/deferred/outline_jfa");
+
+        // Bound once, every program reads its Frame block from binding 0
+        glGenBuffers(1, &frameUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0, frameUBO);
 
         glGenVertexArrays(1, &defferedQuadVAO);
         glGenVertexArrays(1, &screenQuadVAO);
@@ -149,29 +281,97 @@ namespace Deferred
         }
     }
     
-    void DrawShadows()
+    void UpdateSplits()
     {
-        // glCullFace(GL_FRONT);
-        glBindFramebuffer(GL_FRAMEBUFFER, dirShadowMapFBO);
-        glEnable(GL_POLYGON_OFFSET_FILL);
-        glDrawBuffer(GL_NONE);
-        glReadBuffer(GL_NONE);
-        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        const float near = 0.1f;
+        const float far  = ShadowDistance;
 
-        glPolygonOffset(2.0f, 4.0f);
+        for (int i = 0; i < NUM_CASCADES; i++)
+        {
+            float p = float(i + 1) / NUM_CASCADES;
+            float logSplit     = near * std::pow(far / near, p);
+            float uniformSplit = near + (far - near) * p;
+            cascadeSplits[i] = CascadeSplitLambda * logSplit + (1.0f - CascadeSplitLambda) * uniformSplit;
+        }
+    }
 
-        glViewport(0, 0, 2048, 2048);
+    // Narrows [T0, T1] of P + D * t to Lo <= x <= Hi, false once nothing is left
+    inline bool ClipSlab(float P, float D, float Lo, float Hi, float& T0, float& T1)
+    {
+        if (std::abs(D) < 1e-6f) return P >= Lo && P <= Hi;
+
+        float ta = (Lo - P) / D;
+        float tb = (Hi - P) / D;
+        T0 = std::max(T0, std::min(ta, tb));
+        T1 = std::min(T1, std::max(ta, tb));
+        return T0 <= T1;
+    }
 
+    // Light-space depth range of the part of Bounds above the square Center +- Extent, false
+    // if they don't overlap. The extremes of the intersection lie on its vertices, which are
+    // the box edges clipped to the square and the square's vertical edges clipped to the box
+    bool ClipDepthRange(const AM::AABB& Bounds, const glm::mat4& LightView, glm::vec2 Center, float Extent, float& MinZ, float& MaxZ)
+    {
+        glm::vec2 lo = Center - Extent;
+        glm::vec2 hi = Center + Extent;
+        MinZ =  std::numeric_limits<float>::max();
+        MaxZ = -std::numeric_limits<float>::max();
+
+        glm::vec3 corners[8];
+        for (int c = 0; c < 8; c++)
+        {
+            glm::vec3 corner((c & 1) ? Bounds.max.x : Bounds.min.x, (c & 2) ? Bounds.max.y : Bounds.min.y, (c & 4) ? Bounds.max.z : Bounds.min.z);
+            corners[c] = glm::vec3(LightView * glm::vec4(corner, 1.0f));
+        }
+
+        // Edges join corners that differ in one bit
+        for (int c = 0; c < 8; c++)
+            for (int bit = 1; bit < 8; bit <<= 1)
+            {
+                if (c & bit) continue;
+                glm::vec3 p = corners[c];
+                glm::vec3 d = corners[c | bit] - p;
+                float t0 = 0.0f, t1 = 1.0f;
+                if (!ClipSlab(p.x, d.x, lo.x, hi.x, t0, t1) || !ClipSlab(p.y, d.y, lo.y, hi.y, t0, t1)) continue;
+                MinZ = std::min({ MinZ, p.z + d.z * t0, p.z + d.z * t1 });
+                MaxZ = std::max({ MaxZ, p.z + d.z * t0, p.z + d.z * t1 });
+            }
+
+        // Light space is a rotation, along a vertical edge t is the light-space depth
+        glm::mat4 invView = glm::inverse(LightView);
+        glm::vec3 d = glm::vec3(invView * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f));
+        for (int c = 0; c < 4; c++)
+        {
+            glm::vec3 p = glm::vec3(invView * glm::vec4((c & 1) ? hi.x : lo.x, (c & 2) ? hi.y : lo.y, 0.0f, 1.0f));
+            float t0 = -std::numeric_limits<float>::max();
+            float t1 =  std::numeric_limits<float>::max();
+            if (!ClipSlab(p.x, d.x, Bounds.min.x, Bounds.max.x, t0, t1) ||
+                !ClipSlab(p.y, d.y, Bounds.min.y, Bounds.max.y, t0, t1) ||
+                !ClipSlab(p.z, d.z, Bounds.min.z, Bounds.max.z, t0, t1)) continue;
+            MinZ = std::min(MinZ, t0);
+            MaxZ = std::max(MaxZ, t1);
+        }
+        return MinZ <= MaxZ;
+    }
+
+    void UpdateCascades()
+    {
         glm::vec3 lightTarget(0.0f);
         glm::vec3 lightDir(1.0f, -1.0f, 1.0f);
         // glm::vec3 lightPos(10.0f, -10.0f, 10.0f);
 
-        S_shadow->Use();
+        // Rotation only, fits are placed in light space so they snap to a fixed grid
+        const glm::mat4 lightView = glm::lookAt(lightTarget, lightTarget - lightDir, glm::vec3(0.0f, 0.0f, 1.0f));
+
+        AM::AABB scene = Culling::SceneBounds();
+        bool  hasScene = scene.min.x <= scene.max.x;
+
+        UpdateSplits();
+        shadowFrame++;
+        rebuildCascade = -1;
+
         for (int i = 0; i < NUM_CASCADES; i++)
         {
-            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, DirCascades, 0, i);
-            glClear(GL_DEPTH_BUFFER_BIT);
-
             float near = (i == 0) ? 0.1f : cascadeSplits[i - 1];
             float far  = cascadeSplits[i];
 
@@ -189,85 +389,232 @@ namespace Deferred
                 center += glm::vec3(v);
             }
             center /= 8;
-                
-            const auto lightView = glm::lookAt(
-                center + lightDir,
-                center,
-                glm::vec3(0.0f, 0.0f, 1.0f)
-            );
-            
-            float minX = std::numeric_limits<float>::max();
-            float maxX = std::numeric_limits<float>::lowest();
-            float minY = std::numeric_limits<float>::max();
-            float maxY = std::numeric_limits<float>::lowest();
-            float minZ = std::numeric_limits<float>::max();
-            float maxZ = std::numeric_limits<float>::lowest();
+
+            // Rounded up so float noise under rotation doesn't change the texel size
+            float radius = 0.0f;
             for (const auto& v : frustumCorners)
+                radius = std::max(radius, glm::length(glm::vec3(v) - center));
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            glm::vec3 lsCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+            glm::vec2 lsCenterXY(lsCenter.x, lsCenter.y);
+
+            // Depth only has to reach from the topmost caster above the slice to the bottom of
+            // the scene under it, casters outside the square can't shadow anything inside
+            float sceneMinZ, sceneMaxZ;
+            bool  overlap  = hasScene && ClipDepthRange(scene, lightView, lsCenterXY, radius, sceneMinZ, sceneMaxZ);
+            float needNear = overlap ? sceneMaxZ : lsCenter.z + radius;
+            float needFar  = overlap ? std::max(sceneMinZ, lsCenter.z - radius) : lsCenter.z - radius;
+            needNear = std::max(needNear, needFar + 0.01f);
+
+            // The fit is kept while the slice and the scene's depth range stay inside it
+            CascadeCache& cache = cascadeCaches[i];
+            bool fits = ShadowCaching && cache.Fitted && cache.Radius == radius &&
+                        glm::length(lsCenterXY - cache.Center) + radius <= cache.Extent &&
+                        needNear <= cache.NearZ && needFar >= cache.FarZ;
+
+            if (!fits)
             {
-                const auto trf = lightView * v;
-                minX = std::min(minX, trf.x);
-                maxX = std::max(maxX, trf.x);
-                minY = std::min(minY, trf.y);
-                maxY = std::max(maxY, trf.y);
-                minZ = std::min(minZ, trf.z);
-                maxZ = std::max(maxZ, trf.z);
+                // Headroom so small camera moves keep the fit, and with it the cached static layer
+                float padding = ShadowCaching ? radius * ShadowCachePadding : 0.0f;
+
+                // Snapping moves the center by up to a texel diagonal, the square grows to cover it
+                cache.Extent = (radius + padding) * SHADOW_MAP_RES / (SHADOW_MAP_RES - 3.0f);
+                float texel  = 2.0f * cache.Extent / SHADOW_MAP_RES;
+
+                cache.Radius = radius;
+                cache.Center = glm::floor(lsCenterXY / texel) * texel;
+                cache.NearZ  = needNear + padding + 0.05f;
+                cache.FarZ   = needFar  - padding - 0.05f;
+                cache.Fitted = true;
+                cache.StaticValid = false;
             }
+            if (cache.StaticVersion != SM::StaticVersion) cache.StaticValid = false;
 
-            constexpr float zMult = 10.0f;
-            if   (minZ < 0) minZ *= zMult;
-            else minZ /= zMult;
-
-            if   (maxZ < 0) maxZ /= zMult;
-            else maxZ *= zMult;
-            
-            const glm::mat4 lightProj = glm::ortho(minX, maxX, minY, maxY, minZ, maxZ);
+            const glm::mat4 lightProj = glm::ortho(cache.Center.x - cache.Extent, cache.Center.x + cache.Extent,
+                                                   cache.Center.y - cache.Extent, cache.Center.y + cache.Extent,
+                                                   -cache.NearZ, -cache.FarZ);
                 
             // 5. Combine
             lightSpaceMatrices[i] = lightProj * lightView;
 
-            S_shadow->SetMatrix4("lightSpaceMatrix", lightSpaceMatrices[i]);
+            // One static layer is rebuilt per frame, nearest cascade first. The others
+            // that lost their cache draw everything until it is their turn.
+            if (!ShadowCaching)
+                cache.Update = CascadeUpdate::Full;
+            else if (cache.StaticValid)
+                cache.Update = shadowFrame - cache.LastDrawn < ShadowUpdateInterval[i] ? CascadeUpdate::Skip : CascadeUpdate::Cached;
+            else if (rebuildCascade < 0) {
+                cache.Update   = CascadeUpdate::Rebuild;
+                rebuildCascade = i;
+            }
+            else cache.Update = CascadeUpdate::Full;
 
-            for (auto const& [meshID, batch] : SM::DrawList)
-            {
-                const auto& mesh = AM::Meshes.at(meshID);
-                glBindVertexArray(mesh.VAO);
+            Culling::ViewID view = Culling::ViewID(Culling::Cascade0 + i);
+            switch (cache.Update) {
+                case CascadeUpdate::Skip: Culling::ViewCasters[view] = Culling::NoCasters;      break;
+                case CascadeUpdate::Full: Culling::ViewCasters[view] = Culling::AllCasters;     break;
+                default:                  Culling::ViewCasters[view] = Culling::DynamicCasters; break;
+            }
+        }
+
+        Culling::ViewCasters[Culling::CascadeStatic] = rebuildCascade < 0 ? Culling::NoCasters : Culling::StaticCasters;
+        if (rebuildCascade >= 0) Culling::LODBias[Culling::CascadeStatic] = Culling::LODBias[Culling::Cascade0 + rebuildCascade];
+    }
+
+    float Halton(int Index, int Base)
+    {
+        float f = 1.0f, r = 0.0f;
+        for (int i = Index; i > 0; i /= Base)
+        {
+            f /= Base;
+            r += f * (i % Base);
+        }
+        return r;
+    }
 
-                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, batch.SSBOIdx); // Binding point 0
+    void UploadFrameUniforms()
+    {
+        // Sub-pixel offset of this frame in NDC, eight phases of Halton(2, 3). Only the Frame block is
+        // jittered, AM::ProjMat4 stays as it is for culling and the editor
+        glm::vec2 jitter(0.0f);
+        if (TemporalAA)
+        {
+            int phase = int(temporalFrame++ % 8) + 1;
+            jitter.x = (Halton(phase, 2) - 0.5f) * 2.0f / renderSize.x;
+            jitter.y = (Halton(phase, 3) - 0.5f) * 2.0f / renderSize.y;
+        }
+        glm::mat4 projection     = glm::translate(glm::mat4(1.0f), glm::vec3(jitter.x, jitter.y, 0.0f)) * AM::ProjMat4;
+        glm::mat4 viewProjection = AM::ProjMat4 * AM::ViewMat4;
+        if (!hasPrevFrame) prevViewProjection = viewProjection;
+
+        FrameUniforms frame;
+        frame.View            = AM::ViewMat4;
+        frame.Projection      = projection;
+        frame.InvProjection   = glm::inverse(projection);
+        frame.InvView         = glm::inverse(AM::ViewMat4);
+        frame.CameraPosition  = AM::EditorCam.Position;
+        frame.CameraDirection = AM::EditorCam.Front;
+        for (int i = 0; i < NUM_CASCADES; i++) frame.LightSpaceMatrices[i] = lightSpaceMatrices[i];
+        frame.CascadeSplits   = glm::vec4(cascadeSplits[0], cascadeSplits[1], cascadeSplits[2], 0.0f);
+        frame.ViewProjection     = viewProjection;
+        frame.PrevViewProjection = prevViewProjection;
+        frame.Jitter             = glm::vec4(jitter.x, jitter.y, prevJitter.x, prevJitter.y);
+
+        glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+
+        prevViewProjection = viewProjection;
+        prevJitter         = jitter;
+        hasPrevFrame       = true;
+    }
+
+    glm::mat4 GetLightSpaceMatrix(int Cascade)
+    {
+        return lightSpaceMatrices[Cascade];
+    }
+
+    glm::mat4 GetStaticCascadeMatrix()
+    {
+        return rebuildCascade < 0 ? glm::mat4(1.0f) : lightSpaceMatrices[rebuildCascade];
+    }
+
+    const char* CascadeUpdateToString(int Cascade)
+    {
+        switch (cascadeCaches[Cascade].Update) {
+            case CascadeUpdate::Skip:    return "Skipped";
+            case CascadeUpdate::Cached:  return "Cached";
+            case CascadeUpdate::Rebuild: return "Rebuilt";
+            case CascadeUpdate::Full:    return "Full";
+
+            default: return "Unknown";
+        }
+    }
+
+    // Static casters only, S_shadow must be bound with the cascade's lightSpaceMatrix
+    void DrawStaticCascade(int i)
+    {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, DirCascadesStatic, 0, i);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        Culling::DrawView(Culling::CascadeStatic);
+
+        cascadeCaches[i].StaticValid   = true;
+        cascadeCaches[i].StaticVersion = SM::StaticVersion;
+    }
 
-                // Send instance count
-                int instanceCount = static_cast<int>(batch.Objects.size());
-                if (mesh.UseElements)
-                    glDrawElementsInstanced(GL_TRIANGLES, mesh.TriangleCount * 3, GL_UNSIGNED_INT, 0, instanceCount);
-                else
-                    glDrawArraysInstanced(GL_TRIANGLES, 0, mesh.TriangleCount * 3, instanceCount);
+    void CopyStaticCascade(int i)
+    {
+        glCopyImageSubData(DirCascadesStatic, GL_TEXTURE_2D_ARRAY, 0, 0, 0, i,
+                           DirCascades,       GL_TEXTURE_2D_ARRAY, 0, 0, 0, i,
+                           SHADOW_MAP_RES, SHADOW_MAP_RES, 1);
+    }
+
+    // All cascades in one draw of the Shadows view, every entry carries its cascade(s)
+    // in the top bits and is routed to its layer through gl_Layer.
+    // Static layers are still rebuilt one at a time, at most one per frame
+    void DrawShadowsLayered()
+    {
+        bool any = false;
+        for (int i = 0; i < NUM_CASCADES; i++)
+        {
+            CascadeCache& cache = cascadeCaches[i];
+            if (cache.Update == CascadeUpdate::Skip) continue;
+            any = true;
+
+            if (cache.Update == CascadeUpdate::Rebuild) {
+                S_shadow->SetMatrix4("lightSpaceMatrix", lightSpaceMatrices[i]);
+                DrawStaticCascade(i);
             }
 
-            // for (auto const& mesh : AM::Meshes)
-            // {
-            //     if (mesh.second.TriangleCount == 0 || mesh.second.VAO == 0) continue;
-
-            //     int numElements = mesh.second.TriangleCount * 3;
-            //     glBindVertexArray(mesh.second.VAO);
-
-            //     int index = 0;
-            //     for (auto &node : SM::SceneNodes)
-            //     {
-            //         if (node->GetType() == SM::NodeType::Object_)
-            //         {
-            //             SM::Object* object = dynamic_cast<SM::Object*>(node);
-            //             if (object->GetMeshID() == mesh.first)
-            //             {
-            //                 S_shadow->SetMatrix4("model", object->GetModelMatrix());
-            //                 if (mesh.second.UseElements) glDrawElements(GL_TRIANGLES, numElements, GL_UNSIGNED_INT, 0);
-            //                 else glDrawArrays(GL_TRIANGLES, 0, mesh.second.TriangleCount * 3);
-            //             }
-            //             index++;
-            //         }
-            //     }
-            // }
+            if (cache.Update == CascadeUpdate::Full) {
+                float one = 1.0f;
+                glClearTexSubImage(DirCascades, 0, 0, 0, i, SHADOW_MAP_RES, SHADOW_MAP_RES, 1,
+                                   GL_DEPTH_COMPONENT, GL_FLOAT, &one);
+            }
+            else CopyStaticCascade(i);
+            cache.LastDrawn = shadowFrame;
         }
+        if (!any) return;
+
+        // Skipped cascades are culled away on the culling side, their layers are left untouched
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, DirCascades, 0);
+        S_shadowLayered->Use();
+        Culling::DrawView(Culling::Shadows);
+    }
 
-        glViewport(0, 0, Engine::GetWindowSize().x, Engine::GetWindowSize().y);
+    void DrawShadows()
+    {
+        // glCullFace(GL_FRONT);
+        glBindFramebuffer(GL_FRAMEBUFFER, dirShadowMapFBO);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+        glPolygonOffset(2.0f, 4.0f);
+
+        glViewport(0, 0, 2048, 2048);
+
+        S_shadow->Use();
+        SM::BindDrawBuffers();
+        if (Culling::LayeredShadows) DrawShadowsLayered();
+        else for (int i = 0; i < NUM_CASCADES; i++)
+        {
+            CascadeCache& cache = cascadeCaches[i];
+            if (cache.Update == CascadeUpdate::Skip) continue;
+
+            S_shadow->SetMatrix4("lightSpaceMatrix", lightSpaceMatrices[i]);
+            if (cache.Update == CascadeUpdate::Rebuild) DrawStaticCascade(i);
+
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, DirCascades, 0, i);
+            if (cache.Update == CascadeUpdate::Full) glClear(GL_DEPTH_BUFFER_BIT);
+            else CopyStaticCascade(i);
+
+            Culling::DrawView(Culling::ViewID(Culling::Cascade0 + i));
+            cache.LastDrawn = shadowFrame;
+        }
+
+        glViewport(0, 0, renderSize.x, renderSize.y);
         glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 
         glDisable(GL_POLYGON_OFFSET_FILL);
@@ -275,22 +622,74 @@ namespace Deferred
         // glCullFace(GL_BACK);
     }
 
+    // Routes every fragment output to nothing but its own color attachment
+    void DrawOnly(int Attachment)
+    {
+        GLenum buffers[6]{ GL_NONE, GL_NONE, GL_NONE, GL_NONE, GL_NONE, GL_NONE };
+        buffers[Attachment] = GL_COLOR_ATTACHMENT0 + Attachment;
+        glDrawBuffers(Attachment + 1, buffers);
+    }
+
+    // Binds the cascade array twice, raw depth for the blocker search and with comparison for PCF
+    void BindCascades(Shader& S)
+    {
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, DirCascades);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+        S.SetInt("DirShadowMapRaw", ShadowCascades::First);
+
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, DirCascades);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        S.SetInt("DirShadowMap", ShadowCascades::First + 1);
+    }
+
+    // Two 5-tap passes over the resolved factor, through the scratch target and back
+    void BlurShadowFactor()
+    {
+        glm::ivec2 size = renderSize;
+        unsigned int factor = GBuffers[PackedGBuffer ? GNormal : GDirShadowFactor];
+
+        S_shadowBlur->Use();
+        S_shadowBlur->SetInt("source", 0);
+        glActiveTexture(GL_TEXTURE0);
+
+        glBindTexture(GL_TEXTURE_2D, factor);
+        glBindImageTexture(0, shadowBlurScratch, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16F);
+        S_shadowBlur->SetInt("sourceChannel", PackedGBuffer ? 2 : 0);
+        S_shadowBlur->SetBool("vertical", false);
+        S_shadowBlur->SetBool("writePacked", false);
+        glDispatchCompute((size.x + 7) / 8, (size.y + 7) / 8, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        glBindTexture(GL_TEXTURE_2D, shadowBlurScratch);
+        if (PackedGBuffer) glBindImageTexture(1, factor, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGB10_A2);
+        else               glBindImageTexture(0, factor, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16F);
+        S_shadowBlur->SetInt("sourceChannel", 0);
+        S_shadowBlur->SetBool("vertical", true);
+        S_shadowBlur->SetBool("writePacked", PackedGBuffer);
+        glDispatchCompute((size.x + 7) / 8, (size.y + 7) / 8, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
     void CalcShadows()
     {
+        if (ShadowResolveMode == ShadowFused) return;
+
         glDepthMask(false);
+        DrawOnly(PackedGBuffer ? GNormal : 4);
+        if (PackedGBuffer)
+        {
+            // Blue of GNormal is written while rg is fetched, the G-buffer writes have to land first
+            glTextureBarrier();
+            glColorMaski(GNormal, GL_FALSE, GL_FALSE, GL_TRUE, GL_FALSE);
+        }
+
         S_shadowCalc->Use();
-        S_shadowCalc->SetVector3("cDir", AM::EditorCam.Front);
-        S_shadowCalc->SetVector3("cPos", AM::EditorCam.Position);
-        S_shadowCalc->SetMatrix4("iProjMatrix", glm::inverse(AM::ProjMat4));
-        S_shadowCalc->SetMatrix4("viewMatrix",  AM::ViewMat4);
-        S_shadowCalc->SetMatrix4("lightSpaceMatrix", lightSpaceMatrices[0]);
-
-        S_shadowCalc->SetFloat("cascadeSplits[0]", cascadeSplits[0]);
-        S_shadowCalc->SetFloat("cascadeSplits[1]", cascadeSplits[1]);
-        S_shadowCalc->SetFloat("cascadeSplits[2]", cascadeSplits[2]);
-        S_shadowCalc->SetMatrix4(std::format("lightSpaceMatrices[{}]", 0), lightSpaceMatrices[0]);
-        S_shadowCalc->SetMatrix4(std::format("lightSpaceMatrices[{}]", 1), lightSpaceMatrices[1]);
-        S_shadowCalc->SetMatrix4(std::format("lightSpaceMatrices[{}]", 2), lightSpaceMatrices[2]);
+        S_shadowCalc->SetInt("packedGBuffer", PackedGBuffer);
 
         glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_2D, GBuffers[GNormal]);
@@ -300,26 +699,85 @@ namespace Deferred
         glBindTexture(GL_TEXTURE_2D, GBuffers[GDepth]);
         S_shadowCalc->SetInt("GDepth",  GDepth);
 
-        glActiveTexture(GL_TEXTURE6);
-        glBindTexture(GL_TEXTURE_2D_ARRAY, DirCascades);
-        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_NONE);
-        S_shadowCalc->SetInt("DirShadowMapRaw", ShadowCascades::First);
-
-        glActiveTexture(GL_TEXTURE7);
-        glBindTexture(GL_TEXTURE_2D_ARRAY, DirCascades);
-        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        S_shadowCalc->SetInt("DirShadowMap", ShadowCascades::First + 1);
+        BindCascades(*S_shadowCalc);
         
         glBindVertexArray(defferedQuadVAO);
         glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        glColorMaski(GNormal, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
         glDepthMask(true);
+
+        if (ShadowResolveMode == ShadowBlurred) BlurShadowFactor();
+    }
+
+    // Screen rect of the selection in render pixels, widened by the outline, then a jump flood over it.
+    // Seeds never need to travel further than the outline reaches, so the steps start at the largest
+    // power of two under that reach instead of half the rect
+    void FloodOutline(const AM::AABB& Bounds, const glm::mat4& Model)
+    {
+        // The whole target once a corner is behind the camera
+        glm::mat4 mvp = AM::ProjMat4 * AM::ViewMat4 * Model;
+        glm::vec2 lo(1.0f), hi(-1.0f);
+        for (int c = 0; c < 8; c++)
+        {
+            glm::vec3 corner((c & 1) ? Bounds.max.x : Bounds.min.x, (c & 2) ? Bounds.max.y : Bounds.min.y, (c & 4) ? Bounds.max.z : Bounds.min.z);
+            glm::vec4 clip = mvp * glm::vec4(corner, 1.0f);
+            if (clip.w <= 0.0f)
+            {
+                lo = glm::vec2(-1.0f);
+                hi = glm::vec2(1.0f);
+                break;
+            }
+            glm::vec2 ndc(clip.x / clip.w, clip.y / clip.w);
+            lo = c == 0 ? ndc : glm::min(lo, ndc);
+            hi = c == 0 ? ndc : glm::max(hi, ndc);
+        }
+        lo = glm::clamp(lo, glm::vec2(-1.0f), glm::vec2(1.0f));
+        hi = glm::clamp(hi, glm::vec2(-1.0f), glm::vec2(1.0f));
+
+        // A pixel more for the jitter of the mask
+        int reach = (int)std::ceil(OUTLINE_WIDTH * RenderScale) + 2;
+        outlineMin.x = std::max(int((lo.x * 0.5f + 0.5f) * renderSize.x) - reach, 0);
+        outlineMin.y = std::max(int((lo.y * 0.5f + 0.5f) * renderSize.y) - reach, 0);
+        outlineMax.x = std::min(int((hi.x * 0.5f + 0.5f) * renderSize.x) + 1 + reach, renderSize.x);
+        outlineMax.y = std::min(int((hi.y * 0.5f + 0.5f) * renderSize.y) + 1 + reach, renderSize.y);
+
+        int groupsX = (outlineMax.x - outlineMin.x + 7) / 8;
+        int groupsY = (outlineMax.y - outlineMin.y + 7) / 8;
+        if (groupsX <= 0 || groupsY <= 0) return;
+
+        S_outlineJFA->Use();
+        S_outlineJFA->SetIVector4("rect", glm::ivec4(outlineMin.x, outlineMin.y, outlineMax.x, outlineMax.y));
+        S_outlineJFA->SetInt("mask", GMask);
+        S_outlineJFA->SetInt("maskChannel", PackedGBuffer ? 3 : 0);
+        S_outlineJFA->SetInt("seedsIn", GAlbedo);
+
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, GBuffers[PackedGBuffer ? GNormal : GMask]);
+
+        // Seed pass, every masked pixel is its own nearest seed
+        outlineField = 0;
+        S_outlineJFA->SetInt("stepSize", 0);
+        glBindImageTexture(0, outlineSeeds[outlineField], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16I);
+        glDispatchCompute(groupsX, groupsY, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        int step = 1;
+        while (step * 2 <= reach) step *= 2;
+        glActiveTexture(GL_TEXTURE1);
+        for (; step >= 1; step /= 2)
+        {
+            glBindTexture(GL_TEXTURE_2D, outlineSeeds[outlineField]);
+            glBindImageTexture(0, outlineSeeds[outlineField ^ 1], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16I);
+            S_outlineJFA->SetInt("stepSize", step);
+            glDispatchCompute(groupsX, groupsY, 1);
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+            outlineField ^= 1;
+        }
     }
 
     void DrawMask()
     {
+        outlineMin = outlineMax = glm::ivec2(0);
         if (SM::SceneNodes.empty()) return;
         
         SM::Object* object = dynamic_cast<SM::Object*>(SM::SceneNodes[SM::GetSelectedIndex()]);
@@ -328,115 +786,98 @@ namespace Deferred
         {
             glDisable(GL_DEPTH_TEST);
 
+            // Packed, the mask goes to the alpha of GNormal
+            DrawOnly(PackedGBuffer ? GNormal : GMask);
+            if (PackedGBuffer) glColorMaski(GNormal, GL_FALSE, GL_FALSE, GL_FALSE, GL_TRUE);
+
             Deferred::S_mask->Use();
-            Deferred::S_mask->SetMatrix4("projection", AM::ProjMat4);
-            Deferred::S_mask->SetMatrix4("view", AM::ViewMat4);
 
             auto meshIter = AM::Meshes.find(object->GetMeshID());
             if (meshIter != AM::Meshes.end())
             {
-                auto &mesh = meshIter->second;
-                int numElements = mesh.TriangleCount * 3;
-                glBindVertexArray(mesh.VAO);
-
                 Deferred::S_mask->SetMatrix4("model", object->GetModelMatrix());
-                if (mesh.UseElements) glDrawElements(GL_TRIANGLES, numElements, GL_UNSIGNED_INT, 0);
-                else glDrawArrays(GL_TRIANGLES, 0, mesh.TriangleCount * 3);
+                AM::DrawMesh(meshIter->second, GL_TRIANGLES);
+                FloodOutline(meshIter->second.aabb, object->GetModelMatrix());
 
                 glEnable(GL_DEPTH_TEST);
             }
+            glColorMaski(GNormal, GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
         }
     }
 
-    const GLenum buffersGBuffers[]{ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4 };
+    const GLenum buffersGBuffers[]{ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4, GL_COLOR_ATTACHMENT5 };
+    const GLenum buffersPacked[]{ GL_NONE, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_NONE, GL_NONE, GL_COLOR_ATTACHMENT5 };
     void DrawGBuffers()
     {
-        glDrawBuffers(5, buffersGBuffers);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // Velocity is only written for the temporal resolve
+        int count = TemporalAA ? 6 : 5;
+        if (PackedGBuffer)
+        {
+            // GShaded is fully overwritten by DoShading, the mask in GNormal alpha has to start at zero
+            const float zero[4]{ 0.0f, 0.0f, 0.0f, 0.0f };
+            glDrawBuffers(count, buffersPacked);
+            glClearBufferfv(GL_COLOR, GAlbedo, zero);
+            glClearBufferfv(GL_COLOR, GNormal, zero);
+            if (TemporalAA) glClearBufferfv(GL_COLOR, 5, zero);
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+        else
+        {
+            glDrawBuffers(count, buffersGBuffers);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
 
         S_GBuffers->Use();
-        S_GBuffers->SetMatrix4("projection", AM::ProjMat4);
-        S_GBuffers->SetMatrix4("view", AM::ViewMat4);
+        S_GBuffers->SetInt("packedGBuffer", PackedGBuffer);
 
-        for (auto const& [meshID, batch] : SM::DrawList)
-        {
-            const auto& mesh = AM::Meshes.at(meshID);
-            glBindVertexArray(mesh.VAO);
-
-            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, batch.SSBOIdx); // Binding point 0
+        SM::BindDrawBuffers();
+        Culling::DrawView(Culling::CameraView);
 
-            // Send instance count
-            int instanceCount = static_cast<int>(batch.Objects.size());
-            if (mesh.UseElements)
-                glDrawElementsInstanced(GL_TRIANGLES, mesh.TriangleCount * 3, GL_UNSIGNED_INT, 0, instanceCount);
-            else
-                glDrawArraysInstanced(GL_TRIANGLES, 0, mesh.TriangleCount * 3, instanceCount);
-        }
+        // Anything hidden behind last frame's depth gets re-tested against this frame's
+        Culling::CullLate(GBuffers[GDepth]);
 
-        // for (auto const& pair : SM::DrawList)
-        // {
-        //     auto& mesh = AM::Meshes.at(pair.first);
-        //     glBindVertexArray(mesh.VAO);
-            
-        //     for (auto* object : pair.second.Objects)
-        //     {
-        //         S_GBuffers->SetMatrix4("model", object->GetModelMatrix());
-        //         if (mesh.UseElements)
-        //             glDrawElements(GL_TRIANGLES, mesh.TriangleCount * 3, GL_UNSIGNED_INT, 0);
-        //         else
-        //             glDrawArrays(GL_TRIANGLES, 0, mesh.TriangleCount * 3);
-        //     }
-        // }
-
-        // for (auto const& mesh : AM::Meshes)
-        // {
-        //     int numElements = mesh.second.TriangleCount * 3;
-        //     glBindVertexArray(mesh.second.VAO);
-
-        //     for (auto const& obj : SM::DrawList[mesh.first])
-        //     {
-        //         S_GBuffers->SetMatrix4("model", obj->GetModelMatrix());
-        //         if (mesh.second.UseElements) glDrawElements(GL_TRIANGLES, numElements, GL_UNSIGNED_INT, 0);
-        //         else glDrawArrays(GL_TRIANGLES, 0, mesh.second.TriangleCount * 3);
-        //     }
-
-        //     // int index = 0;
-        //     // for (auto &node : SM::SceneNodes)
-        //     // {
-        //     //     if (node->GetType() == SM::NodeType::Object_)
-        //     //     {
-        //     //         SM::Object* object = dynamic_cast<SM::Object*>(node);
-        //     //         if (object->GetMeshID() == mesh.first)
-        //     //         {
-        //     //             S_GBuffers->SetMatrix4("model", object->GetModelMatrix());
-        //     //             if (mesh.second.UseElements) glDrawElements(GL_TRIANGLES, numElements, GL_UNSIGNED_INT, 0);
-        //     //             else glDrawArrays(GL_TRIANGLES, 0, mesh.second.TriangleCount * 3);
-        //     //         }
-        //     //         index++;
-        //     //     }
-        //     // }
-        // }
+        S_GBuffers->Use();
+        SM::BindDrawBuffers();
+        Culling::DrawView(Culling::CameraLate);
     }
 
     void Resize(int width, int height)
     {
+        windowSize = glm::ivec2(width, height);
+        Allocate();
+    }
+
+    void Allocate()
+    {
+        renderSize = glm::max(glm::ivec2(int(windowSize.x * RenderScale + 0.5f), int(windowSize.y * RenderScale + 0.5f)), glm::ivec2(1));
+        int width  = renderSize.x;
+        int height = renderSize.y;
+
+        // RGBA so the tiled shading path can image store into it, linear for the upscale
         glBindTexture(GL_TEXTURE_2D, GBuffers[GShaded]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0,  GL_RGB, GL_UNSIGNED_BYTE, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0,  GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
         glBindTexture(GL_TEXTURE_2D, GBuffers[GAlbedo]);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0,  GL_RGBA, GL_UNSIGNED_BYTE, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
+        // Packed, the outline pass reads the mask from GNormal alpha and needs it clamped too
         glBindTexture(GL_TEXTURE_2D, GBuffers[GNormal]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, NULL);
+        if (PackedGBuffer) glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, width, height, 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, NULL);
+        else               glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F,  width, height, 0, GL_RGBA, GL_FLOAT, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
+        // Unused when packed, shrunk to a texel and detached so they don't limit the render area
         glBindTexture(GL_TEXTURE_2D, GBuffers[GMask]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0,  GL_RED, GL_UNSIGNED_BYTE, NULL);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, PackedGBuffer ? 1 : width, PackedGBuffer ? 1 : height, 0,  GL_RED, GL_UNSIGNED_BYTE, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -447,10 +888,158 @@ namespace Deferred
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
+        // Also unused when the shadow factor is fused into shading
+        bool separateShadows = !PackedGBuffer && ShadowResolveMode != ShadowFused;
         glBindTexture(GL_TEXTURE_2D, GBuffers[GDirShadowFactor]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, width, height, 0,  GL_RED, GL_FLOAT, NULL);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, separateShadows ? width : 1, separateShadows ? height : 1, 0,  GL_RED, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        bool blurShadows = ShadowResolveMode == ShadowBlurred;
+        glBindTexture(GL_TEXTURE_2D, shadowBlurScratch);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, blurShadows ? width : 1, blurShadows ? height : 1, 0,  GL_RED, GL_FLOAT, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        for (int i = 0; i < 2; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D, outlineSeeds[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16I, width, height, 0, GL_RG_INTEGER, GL_SHORT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+
+        // Screen-space motion in uv units, dropped with TemporalAA
+        glBindTexture(GL_TEXTURE_2D, GBuffers[GVelocity]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, TemporalAA ? width : 1, TemporalAA ? height : 1, 0,  GL_RG, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, gbufferFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, PackedGBuffer ? 0 : GBuffers[GMask], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D, separateShadows ? GBuffers[GDirShadowFactor] : 0, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT5, GL_TEXTURE_2D, TemporalAA ? GBuffers[GVelocity] : 0, 0);
+
+        // The history only follows the window, and is left at a texel while unused
+        glm::ivec2 history = TemporalAA ? windowSize : glm::ivec2(1);
+        if (history != historySize)
+        {
+            historySize  = history;
+            historyValid = false;
+            for (int i = 0; i < 2; i++)
+            {
+                glBindTexture(GL_TEXTURE_2D, taaHistory[i]);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, history.x, history.y, 0, GL_RGBA, GL_FLOAT, NULL);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            }
+        }
+    }
+
+    void SetPackedGBuffer(bool Packed)
+    {
+        PackedGBuffer = Packed;
+        Allocate();
+    }
+
+    void SetTemporalAA(bool Enabled)
+    {
+        TemporalAA   = Enabled;
+        historyValid = false;
+        Allocate();
+    }
+
+    void SetShadowResolve(ShadowResolve Mode)
+    {
+        ShadowResolveMode = Mode;
+        Allocate();
+    }
+
+    glm::ivec2 GetRenderSize()
+    {
+        return renderSize;
+    }
+
+    void SetDynamicResolution(bool Enabled)
+    {
+        DynamicResolution = Enabled;
+        smoothedGpuMs     = 0.0f;
+        framesSinceChange = 0;
+        framesUnderBudget = 0;
+        if (!Enabled && RenderScale != 1.0f)
+        {
+            RenderScale = 1.0f;
+            Allocate();
+        }
+    }
+
+    void UpdateRenderScale(float GpuMilliseconds)
+    {
+        if (!DynamicResolution || GpuMilliseconds <= 0.0f) return;
+
+        smoothedGpuMs = smoothedGpuMs == 0.0f ? GpuMilliseconds : glm::mix(smoothedGpuMs, GpuMilliseconds, 0.1f);
+        if (++framesSinceChange < SETTLE_FRAMES) return;
+
+        float scale = RenderScale;
+        if (smoothedGpuMs > TargetFrameMs)
+        {
+            // Cost follows the pixel count, so the scale goes with the square root of the ratio
+            scale = std::floor(RenderScale * std::sqrt(TargetFrameMs / smoothedGpuMs) / SCALE_STEP) * SCALE_STEP;
+            framesUnderBudget = 0;
+        }
+        else if (smoothedGpuMs < TargetFrameMs * HEADROOM)
+        {
+            if (++framesUnderBudget >= UPSCALE_FRAMES) scale = RenderScale + SCALE_STEP;
+        }
+        else framesUnderBudget = 0;
+
+        scale = glm::clamp(std::round(scale / SCALE_STEP) * SCALE_STEP, MinRenderScale, 1.0f);
+        if (std::abs(scale - RenderScale) < SCALE_STEP * 0.5f) return;
+
+        RenderScale       = scale;
+        smoothedGpuMs     = 0.0f;
+        framesSinceChange = 0;
+        framesUnderBudget = 0;
+        Allocate();
+    }
+
+    const char* ShadowResolveToString(ShadowResolve Mode)
+    {
+        switch (Mode) {
+            case ShadowFused:    return "Fused";
+            case ShadowSeparate: return "Separate";
+            case ShadowBlurred:  return "Separate, blurred";
+
+            default: return "Unknown";
+        }
+    }
+
+    int GBufferBytesPerPixel()
+    {
+        // Estimate from the formats, clears count as a write. Packed, the mask and the
+        // shadow factor cost a whole GNormal texel wherever they are touched
+        const int shaded = 4, albedo = 4, depth = 4, scratch = 2;
+        const int normal = PackedGBuffer ? 4 : 8;
+        const int mask   = PackedGBuffer ? normal : 1;
+        const int shadow = PackedGBuffer ? normal : 2;
+        bool separate = ShadowResolveMode != ShadowFused;
+        bool ownShadowTarget = separate && !PackedGBuffer;
+
+        int bytes = albedo + normal + depth;                                          // G-buffers
+        if (!PackedGBuffer) bytes += shaded + mask + (ownShadowTarget ? shadow : 0);  // Clears
+        if (separate) bytes += normal + depth + shadow;                               // CalcShadows
+        if (ShadowResolveMode == ShadowBlurred)
+            bytes += shadow + scratch + scratch + (PackedGBuffer ? 2 * shadow : shadow);
+        bytes += albedo + normal + depth + shaded + (ownShadowTarget ? shadow : 0);   // Shading
+        bytes += shaded;                                                              // Outline, the mask only near the selection
+
+        // Velocity write, the resolve's velocity, depth and GShaded reads and the RGBA16F history
+        // read and write. Post process then reads the history instead of GShaded
+        const int velocity = 4, history = 8;
+        if (TemporalAA) bytes += velocity + (velocity + depth + shaded) + 2 * history + (history - shaded);
+        return bytes;
     }
 
     unsigned int &GetGBufferFBO()
@@ -476,29 +1065,74 @@ namespace Deferred
         glEnable(GL_DEPTH_TEST);
     }
 
+    void ResolveTemporal()
+    {
+        if (!TemporalAA) return;
+
+        int write = historyIndex ^ 1;
+
+        S_taa->Use();
+        S_taa->SetInt("current",   GShaded);
+        S_taa->SetInt("history",   GAlbedo);
+        S_taa->SetInt("GDepth",    GDepth);
+        S_taa->SetInt("GVelocity", GVelocity);
+        S_taa->SetInt("historyValid", historyValid);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, GBuffers[GShaded]);
+        // The history takes GAlbedo's unit, nothing else reads albedo here
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, taaHistory[historyIndex]);
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, GBuffers[GDepth]);
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, GBuffers[GVelocity]);
+
+        glBindImageTexture(0, taaHistory[write], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        glDispatchCompute((historySize.x + 7) / 8, (historySize.y + 7) / 8, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        historyIndex = write;
+        historyValid = true;
+    }
+
+    unsigned int GetTemporalHistory()
+    {
+        return taaHistory[historyIndex];
+    }
+
     void DoPostProcessAndDisplay()
     {
         S_postprocessQuad->Use();
         S_postprocessQuad->SetInt("framebuffer", GShaded);
         S_postprocessQuad->SetInt("mask", GMask);
+        S_postprocessQuad->SetInt("maskChannel", PackedGBuffer ? 3 : 0);
         S_postprocessQuad->SetVector2("size", Engine::GetWindowSize());
+        S_postprocessQuad->SetInt("outlineSeeds", GAlbedo);
+        S_postprocessQuad->SetIVector4("outlineRect", glm::ivec4(outlineMin.x, outlineMin.y, outlineMax.x, outlineMax.y));
+        S_postprocessQuad->SetFloat("outlineWidth", OUTLINE_WIDTH);
+        // The resolve already brought the frame to window size
+        S_postprocessQuad->SetInt("upscale", !TemporalAA && renderSize != windowSize);
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, GBuffers[GShaded]);
+        glBindTexture(GL_TEXTURE_2D, TemporalAA ? taaHistory[historyIndex] : GBuffers[GShaded]);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, outlineSeeds[outlineField]);
         glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, GBuffers[GMask]);
+        glBindTexture(GL_TEXTURE_2D, GBuffers[PackedGBuffer ? GNormal : GMask]);
 
         glBindVertexArray(defferedQuadVAO);
 
         glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
     }
 
-    void DrawTexturedQuad(glm::vec2 bottomLeft, glm::vec2 topRight, unsigned int texture, bool singleChannel, bool sampleStencil, bool linearize)
+    void DrawTexturedQuad(glm::vec2 bottomLeft, glm::vec2 topRight, unsigned int texture, bool singleChannel, bool sampleStencil, bool linearize, int channel)
     {
         S_texture->Use();
         S_texture->SetInt("isDepth", singleChannel);
         S_texture->SetInt("sampleStencil", sampleStencil);
         S_texture->SetInt("linearize", linearize);
+        S_texture->SetInt("channel", channel);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, texture);
 
@@ -543,45 +1177,53 @@ namespace Deferred
         glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
     }
 
-    void DoShading()
+    // G-buffer textures, lights and shadow inputs shared by the fragment and the tiled shading path
+    void BindShadingInputs(Shader& S)
     {
-        glDepthMask(false);
-        S_shading->Use();
-        S_shading->SetVector3("cDir", AM::EditorCam.Front);
-        S_shading->SetVector3("cPos", AM::EditorCam.Position);
-        S_shading->SetMatrix4("iProjMatrix", glm::inverse(AM::ProjMat4));
-        S_shading->SetMatrix4("viewMatrix",  AM::ViewMat4);
-        // S_shading->SetMatrix4(std::format("lightSpaceMatrices[{}]", 0), lightSpaceMatrices[0]);
-
-        S_shading->SetInt("NumPointLights", SM::NumLights);
-        int li = 0;
-        for (size_t i = 0; i < SM::SceneNodes.size(); i++)
-        {
-            SM::Light* light = dynamic_cast<SM::Light*>(SM::SceneNodes[i]);
-            if (light)
-            {
-                S_shading->SetVector3(std::format("PointLights[{}].", li) + "position",  light->GetPosition());
-                S_shading->SetVector3(std::format("PointLights[{}].", li) + "color",     light->GetColor());
-                S_shading->SetFloat(std::format("PointLights[{}].",   li) + "intensity", light->GetIntensity());
-                li++;
-            }
-        }
-        
+        S.SetInt("packedGBuffer", PackedGBuffer);
+        S.SetInt("fusedShadows", ShadowResolveMode == ShadowFused);
+        Lighting::BindClusters(S);
+        SSAO::Bind(S);
+        if (ShadowResolveMode == ShadowFused) BindCascades(S);
+
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, GBuffers[GAlbedo]);
-        S_shading->SetInt("GAlbedo", GAlbedo);
+        S.SetInt("GAlbedo", GAlbedo);
 
         glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_2D, GBuffers[GNormal]);
-        S_shading->SetInt("GNormal", GNormal);
+        S.SetInt("GNormal", GNormal);
 
         glActiveTexture(GL_TEXTURE4);
         glBindTexture(GL_TEXTURE_2D, GBuffers[GDepth]);
-        S_shading->SetInt("GDepth",  GDepth);
+        S.SetInt("GDepth",  GDepth);
 
         glActiveTexture(GL_TEXTURE5);
         glBindTexture(GL_TEXTURE_2D, GBuffers[GDirShadowFactor]);
-        S_shading->SetInt("GDirShadowFactor",  GDirShadowFactor);
+        S.SetInt("GDirShadowFactor",  GDirShadowFactor);
+    }
+
+    void DoShading()
+    {
+        if (TiledShading)
+        {
+            glm::ivec2 size = renderSize;
+
+            S_shadingTiled->Use();
+            BindShadingInputs(*S_shadingTiled);
+            S_shadingTiled->SetInt("numLights", Lighting::NumLights);
+
+            glBindImageTexture(0, GBuffers[GShaded], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+            glDispatchCompute((size.x + 15) / 16, (size.y + 15) / 16, 1);
+
+            // Editor overlays draw into GShaded next, post process samples it
+            glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+            return;
+        }
+
+        glDepthMask(false);
+        S_shading->Use();
+        BindShadingInputs(*S_shading);
         
         glBindVertexArray(defferedQuadVAO);
         glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
@@ -597,6 +1239,7 @@ namespace Deferred
             unsigned int texture;
             std::string title;
             bool singleChannel = false;
+            int  channel = 0;
         };
  
         std::vector<QuadInfo> quads =
@@ -604,11 +1247,11 @@ namespace Deferred
             { {1.0f - length * 2, 1.0f - length},     {1.0f - length, 1.0f},          GBuffers[GAlbedo], "GAlbedo" },
             { {1.0f - length, 1.0f - length},         {1.0f, 1.0f},                   GBuffers[GNormal], "GNormal" },
             { {1.0f - length * 2, 1.0f - length * 2}, {1.0f - length, 1.0f - length}, GBuffers[GDepth],  "Gdepth", true },
-            { {1.0f - length, 1.0f - length * 2},     {1.0f, 1.0f - length},          GBuffers[GMask],   "GMask",  true}
+            { {1.0f - length, 1.0f - length * 2},     {1.0f, 1.0f - length},          GBuffers[PackedGBuffer ? GNormal : GMask], "GMask", true, PackedGBuffer ? 3 : 0 }
         };
 
         for (auto& quad : quads) {
-            DrawTexturedQuad(quad.BottomLeft, quad.TopRight, quad.texture, quad.singleChannel);
+            DrawTexturedQuad(quad.BottomLeft, quad.TopRight, quad.texture, quad.singleChannel, false, false, quad.channel);
 
             glm::ivec2 pos = qk::NDCToPixel(quad.TopRight.x - length * 0.5f, quad.TopRight.y);
             Text::RenderCenteredBG(quad.title, pos.x, pos.y - Text::CalculateMaxTextAscent("G", textScale), textScale, glm::vec3(0.9f), glm::vec3(0.05f));
@@ -637,22 +1280,28 @@ namespace Deferred
         glm::vec2 tr2 = bl2 + glm::vec2(length, height);
         DrawTexturedAQuad(bl2, tr2, DirCascades, 2, true);
 
-        // SHadow Factor
+        // SHadow Factor, not stored when fused
+        if (ShadowResolveMode == ShadowFused) return;
         glm::vec2 bottomLeft(1.0f - length * 2.5f, 1.0f - length * 1.5f);
-        DrawTexturedQuad(bottomLeft, topright - glm::vec2(length, 0.0f), GBuffers[GDirShadowFactor], true);
+        DrawTexturedQuad(bottomLeft, topright - glm::vec2(length, 0.0f), GBuffers[PackedGBuffer ? GNormal : GDirShadowFactor], true, false, false, PackedGBuffer ? 2 : 0);
     }
 
     void ReloadShaders()
     {
         S_GBuffers->Reload();
         S_shading->Reload();
+        S_shadingTiled->Reload();
         S_shadow->Reload();
+        S_shadowLayered->Reload();
         S_shadowCalc->Reload();
+        S_shadowBlur->Reload();
         S_mask->Reload();
         S_texture->Reload();
         S_texturea->Reload();
         S_fullscreenQuad->Reload();
         S_postprocessQuad->Reload();
+        S_taa->Reload();
+        S_outlineJFA->Reload();
     }
     
     void CheckFBOStatus(std::string FBOName)
@@ -12,6 +12,7 @@ namespace Deferred
         GMask            = 3,
         GDepth           = 4,
         GDirShadowFactor = 5,
+        GVelocity        = 6,
     };
 
     enum ShadowCascades
@@ -23,26 +24,105 @@ namespace Deferred
 
     inline std::unique_ptr<Shader> S_GBuffers;
     inline std::unique_ptr<Shader> S_shading;
+    inline std::unique_ptr<Shader> S_shadingTiled;
     inline std::unique_ptr<Shader> S_shadow;
+    inline std::unique_ptr<Shader> S_shadowLayered;
     inline std::unique_ptr<Shader> S_shadowCalc;
+    inline std::unique_ptr<Shader> S_shadowBlur;
     inline std::unique_ptr<Shader> S_mask;
     inline std::unique_ptr<Shader> S_postprocessQuad;
+    inline std::unique_ptr<Shader> S_taa;
+    inline std::unique_ptr<Shader> S_outlineJFA;
 
-    inline unsigned int GBuffers[6];
+    inline unsigned int GBuffers[7];
+
+    // Cascade splits blend a logarithmic (lambda 1) and a uniform (lambda 0) split of the shadowed range
+    inline float CascadeSplitLambda = 0.5f;
+    inline float ShadowDistance     = 55.0f;
+
+    // Static casters of every cascade are cached in their own layer and only redrawn when the
+    // cascade refits or a static object changes, dynamic casters are drawn over a copy each frame.
+    // A fit is kept while the cascade slice stays inside it, padded by ShadowCachePadding of its radius.
+    // Cascades with a valid cache only redraw every ShadowUpdateInterval frames.
+    inline bool  ShadowCaching           = true;
+    inline float ShadowCachePadding      = 0.1f;
+    inline int   ShadowUpdateInterval[3] = { 1, 2, 4 };
+
+    // Packed G-buffer: GNormal becomes RGB10_A2 with the octahedral normal, the dir shadow factor
+    // and the selection mask, GMask and GDirShadowFactor are dropped, and GAlbedo alpha packs
+    // roughness and metallic into a byte. Wide keeps both at full precision, roughness in GAlbedo
+    // alpha and metallic in GNormal alpha. Must match res/shaders/common/gbuffer.glsl
+    inline bool PackedGBuffer = true;
+
+    // Where the dir shadow factor comes from. Fused evaluates the cascades in DoShading, Separate
+    // resolves them into the G-buffer in CalcShadows and Blurred adds a separable blur on top of that
+    enum ShadowResolve
+    {
+        ShadowFused    = 0,
+        ShadowSeparate = 1,
+        ShadowBlurred  = 2,
+    };
+    inline ShadowResolve ShadowResolveMode = ShadowFused;
+
+    // Shades 16x16 tiles in a compute shader that culls the lights against each tile's depth bounds,
+    // instead of the fullscreen fragment pass over the light clusters. Switched from the Debug menu
+    inline bool TiledShading = true;
+
+    // Dynamic resolution, the G-buffers are allocated at RenderScale of the window and upscaled in
+    // DoPostProcessAndDisplay. UpdateRenderScale steers the scale toward TargetFrameMs of GPU time
+    inline bool  DynamicResolution = true;
+    inline float TargetFrameMs     = 1000.0f / 60.0f;
+    inline float MinRenderScale    = 0.5f;
+    inline float RenderScale       = 1.0f;
+
+    // Temporal AA, the projection is jittered over a Halton(2, 3) sequence and ResolveTemporal
+    // accumulates the frames into a window sized history, reprojected through GVelocity.
+    // Also the upscale from RenderScale when on
+    inline bool TemporalAA = true;
 
     void Initialize();
+    glm::ivec2 GetRenderSize();
+    void SetDynamicResolution(bool Enabled);
+
+    // Takes the GPU time of the last measured frame, reallocates the G-buffers when the scale moves
+    void UpdateRenderScale(float GpuMilliseconds);
+    void SetPackedGBuffer(bool Packed);
+    void SetTemporalAA(bool Enabled);
+    void SetShadowResolve(ShadowResolve Mode);
+    const char* ShadowResolveToString(ShadowResolve Mode);
+
+    // Estimated bytes each pixel reads and writes through the deferred passes with the current layout
+    int GBufferBytesPerPixel();
+
+    // Draws the selection into the mask and jump floods the nearest masked pixel over its screen
+    // rect, the outline in DoPostProcessAndDisplay only looks at pixels inside that rect
     void DrawMask();
     void DrawGBuffers();
+    void UpdateCascades();
+
+    // Fills the Frame uniform block (binding 0) from the camera and the cascades, after UpdateCascades
+    void UploadFrameUniforms();
     void DrawShadows();
     void CalcShadows();
     void DoShading();
 
+    // Blends the shaded frame into the history, after the editor has drawn into GShaded
+    void ResolveTemporal();
+
+    // Latest resolved frame, window sized RGBA16F, only written while TemporalAA is on
+    unsigned int GetTemporalHistory();
+
     unsigned int &GetGBufferFBO();
     unsigned int &GetShadowFBO();
+    glm::mat4 GetLightSpaceMatrix(int Cascade);
+
+    // Matrix of the cascade whose static layer is rebuilt this frame, culled as Culling::CascadeStatic
+    glm::mat4 GetStaticCascadeMatrix();
+    const char* CascadeUpdateToString(int Cascade);
     
     void DrawFullscreenQuad(unsigned int texture);
     void DoPostProcessAndDisplay();
-    void DrawTexturedQuad(glm::vec2 bottomLeft, glm::vec2 topRight, unsigned int texture, bool singleChannel = false, bool sampleStencil = false, bool linearize = false);
+    void DrawTexturedQuad(glm::vec2 bottomLeft, glm::vec2 topRight, unsigned int texture, bool singleChannel = false, bool sampleStencil = false, bool linearize = false, int channel = 0);
     void DrawTexturedAQuad(glm::vec2 bottomLeft, glm::vec2 topRight, unsigned int textureArray, int layer, bool singleChannel = false, bool sampleStencil = false, bool linearize = false);
     void VisualizeGBuffers();
     void VisualizeShadowMap();
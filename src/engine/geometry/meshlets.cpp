@@ -0,0 +1,168 @@
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+
+#include "meshlets.h"
+#include "simplify.h"
+
+namespace AM::Geometry
+{
+    // Bounding sphere around the AABB center and the cone every triangle normal fits in.
+    // The cutoff is the sine of the cone's half angle, see Culling::MeshletVisible.
+    void ComputeMeshletBounds(const std::vector<VtxData>& Vertices, const unsigned int* Indices, Meshlet& meshlet)
+    {
+        glm::vec3 min( std::numeric_limits<float>::max());
+        glm::vec3 max(-std::numeric_limits<float>::max());
+        for (unsigned int i = 0; i < meshlet.IndexCount; i++) {
+            min = glm::min(min, Vertices[Indices[i]].Position);
+            max = glm::max(max, Vertices[Indices[i]].Position);
+        }
+
+        meshlet.Center = (min + max) * 0.5f;
+        meshlet.Radius = 0.0f;
+        for (unsigned int i = 0; i < meshlet.IndexCount; i++)
+            meshlet.Radius = std::max(meshlet.Radius, glm::length(Vertices[Indices[i]].Position - meshlet.Center));
+
+        std::vector<glm::vec3> normals;
+        normals.reserve(meshlet.IndexCount / 3);
+
+        glm::vec3 axis(0.0f);
+        for (unsigned int i = 0; i < meshlet.IndexCount; i += 3)
+        {
+            const glm::vec3& a = Vertices[Indices[i + 0]].Position;
+            const glm::vec3& b = Vertices[Indices[i + 1]].Position;
+            const glm::vec3& c = Vertices[Indices[i + 2]].Position;
+
+            glm::vec3 n = glm::cross(b - a, c - a);
+            float length = glm::length(n);
+            if (length == 0.0f) continue;
+
+            axis += n;
+            normals.push_back(n / length);
+        }
+
+        meshlet.ConeAxis   = glm::vec3(0.0f, 0.0f, 1.0f);
+        meshlet.ConeCutoff = 1.0f;
+
+        float axisLength = glm::length(axis);
+        if (axisLength == 0.0f || normals.empty()) return;
+        axis /= axisLength;
+
+        float minDot = 1.0f;
+        for (const glm::vec3& n : normals) minDot = std::min(minDot, glm::dot(axis, n));
+
+        // Normals spread over a hemisphere or more, some triangle always faces the camera
+        if (minDot <= 0.0f) return;
+
+        meshlet.ConeAxis   = axis;
+        meshlet.ConeCutoff = std::sqrt(1.0f - minDot * minDot);
+    }
+
+    void BuildMeshlets(MeshData& Data)
+    {
+        Data.Meshlets.clear();
+
+        const std::vector<VtxData>& vertices = Data.VertexData;
+        unsigned int indexCount    = Data.LODs.empty() ? Data.Indices.size() : Data.LODs[0].IndexCount;
+        unsigned int triangleCount = indexCount / 3;
+        if (triangleCount <= MESHLET_MAX_TRIANGLES) return;
+
+        // Triangles around every position, neighbours are found across normal seams too
+        std::vector<unsigned int> canonical = PositionRemap(vertices);
+        std::vector<unsigned int> adjacencyOffsets(vertices.size() + 1, 0);
+        std::vector<unsigned int> adjacency(triangleCount * 3);
+
+        for (unsigned int i = 0; i < triangleCount * 3; i++) adjacencyOffsets[canonical[Data.Indices[i]] + 1]++;
+        for (size_t v = 0; v < vertices.size(); v++) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+        std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (unsigned int i = 0; i < triangleCount * 3; i++) adjacency[fill[canonical[Data.Indices[i]]]++] = i / 3;
+
+        std::vector<uint8_t>      emitted(triangleCount, 0);
+        std::vector<int>          vertexMeshlet(vertices.size(), -1);
+        std::vector<unsigned int> positions;
+        std::vector<unsigned int> reordered;
+        reordered.reserve(triangleCount * 3);
+
+        int current       = 0;
+        int usedVertices  = 0;
+        int usedTriangles = 0;
+        unsigned int cursor = 0;
+
+        auto newVertices = [&](unsigned int t)
+        {
+            int count = 0;
+            for (int c = 0; c < 3; c++) count += vertexMeshlet[Data.Indices[t * 3 + c]] != current;
+            return count;
+        };
+
+        auto close = [&]()
+        {
+            if (usedTriangles == 0) return;
+
+            Meshlet meshlet;
+            meshlet.IndexCount = usedTriangles * 3;
+            meshlet.FirstIndex = reordered.size() - meshlet.IndexCount;
+            ComputeMeshletBounds(vertices, &reordered[meshlet.FirstIndex], meshlet);
+            Data.Meshlets.push_back(meshlet);
+
+            current++;
+            usedVertices  = 0;
+            usedTriangles = 0;
+            positions.clear();
+        };
+
+        // Greedy growth, always takes the neighbouring triangle that adds the fewest
+        // vertices so meshlets stay compact and their cones narrow
+        while (true)
+        {
+            int best    = -1;
+            int bestNew = 4;
+            for (size_t p = 0; p < positions.size() && bestNew > 0; p++)
+                for (unsigned int k = adjacencyOffsets[positions[p]]; k < adjacencyOffsets[positions[p] + 1]; k++)
+                {
+                    unsigned int t = adjacency[k];
+                    if (emitted[t]) continue;
+
+                    int count = newVertices(t);
+                    if (count < bestNew) {
+                        best    = t;
+                        bestNew = count;
+                        if (count == 0) break;
+                    }
+                }
+
+            // Nothing connected left, continue with the next triangle in the original order
+            if (best < 0) {
+                while (cursor < triangleCount && emitted[cursor]) cursor++;
+                if (cursor == triangleCount) break;
+
+                best    = cursor;
+                bestNew = newVertices(cursor);
+            }
+
+            if (usedVertices + bestNew > MESHLET_MAX_VERTICES || usedTriangles + 1 > MESHLET_MAX_TRIANGLES) {
+                close();
+                bestNew = newVertices(best);
+            }
+
+            for (int c = 0; c < 3; c++)
+            {
+                unsigned int v = Data.Indices[best * 3 + c];
+                if (vertexMeshlet[v] != current) {
+                    vertexMeshlet[v] = current;
+                    positions.push_back(canonical[v]);
+                }
+                reordered.push_back(v);
+            }
+
+            usedVertices += bestNew;
+            usedTriangles++;
+            emitted[best] = 1;
+        }
+        close();
+
+        std::copy(reordered.begin(), reordered.end(), Data.Indices.begin());
+    }
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "../asset_manager.h"
+
+namespace AM::Geometry
+{
+    inline constexpr int MESHLET_MAX_VERTICES  = 64;
+    inline constexpr int MESHLET_MAX_TRIANGLES = 124;
+
+    // Reorders the LOD 0 index range so every meshlet is a contiguous run and fills
+    // Data.Meshlets. Meshes that fit into a single meshlet get none.
+    void BuildMeshlets(MeshData& Data);
+}
\ No newline at end of file
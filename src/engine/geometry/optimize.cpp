@@ -0,0 +1,299 @@
+#include <cstdint>
+#include <numeric>
+#include <algorithm>
+
+#include "optimize.h"
+
+namespace AM::Geometry
+{
+    // FIFO cache simulation, a vertex hits while fewer than VERTEX_CACHE_SIZE misses happened since it was loaded
+    struct CacheSimulation
+    {
+        std::vector<unsigned int> LoadedAt;
+        unsigned int Time = VERTEX_CACHE_SIZE + 1;
+
+        explicit CacheSimulation(size_t VertexCount) : LoadedAt(VertexCount, 0) {}
+
+        bool Miss(unsigned int v)
+        {
+            if (Time - LoadedAt[v] <= VERTEX_CACHE_SIZE) return false;
+            LoadedAt[v] = Time++;
+            return true;
+        }
+
+        void Flush() { Time += VERTEX_CACHE_SIZE + 1; }
+    };
+
+    float ACMR(const unsigned int* Indices, size_t IndexCount, size_t VertexCount)
+    {
+        if (IndexCount < 3) return 0.0f;
+
+        CacheSimulation cache(VertexCount);
+        size_t misses = 0;
+        for (size_t i = 0; i < IndexCount; i++) misses += cache.Miss(Indices[i]);
+
+        return float(misses) / float(IndexCount / 3);
+    }
+
+    // Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+    // Fans around one vertex at a time, the next fan is a neighbour that will still be cached.
+    void OptimizeVertexCache(unsigned int* Indices, size_t IndexCount, size_t VertexCount)
+    {
+        size_t triangleCount = IndexCount / 3;
+        if (triangleCount < 2) return;
+
+        std::vector<int> live(VertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++) live[Indices[i]]++;
+
+        std::vector<unsigned int> adjacencyOffsets(VertexCount + 1, 0);
+        for (size_t v = 0; v < VertexCount; v++) adjacencyOffsets[v + 1] = adjacencyOffsets[v] + live[v];
+
+        std::vector<unsigned int> adjacency(triangleCount * 3);
+        std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; i++) adjacency[fill[Indices[i]]++] = i / 3;
+
+        std::vector<int>          cacheTime(VertexCount, 0);
+        std::vector<uint8_t>      emitted(triangleCount, 0);
+        std::vector<unsigned int> deadEnd;
+        std::vector<unsigned int> candidates;
+        std::vector<unsigned int> result;
+        result.reserve(triangleCount * 3);
+
+        int    time   = VERTEX_CACHE_SIZE + 1;
+        size_t cursor = 0;
+        int    fan    = Indices[0];
+
+        while (fan >= 0)
+        {
+            candidates.clear();
+            for (unsigned int k = adjacencyOffsets[fan]; k < adjacencyOffsets[fan + 1]; k++)
+            {
+                unsigned int t = adjacency[k];
+                if (emitted[t]) continue;
+
+                for (int c = 0; c < 3; c++)
+                {
+                    unsigned int v = Indices[t * 3 + c];
+                    result.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+
+                    if (time - cacheTime[v] > VERTEX_CACHE_SIZE) cacheTime[v] = time++;
+                }
+                emitted[t] = 1;
+            }
+
+            // Oldest candidate that stays cached while its remaining triangles are emitted
+            fan = -1;
+            int bestPriority = -1;
+            for (unsigned int v : candidates)
+            {
+                if (live[v] == 0) continue;
+
+                int priority = time - cacheTime[v] + 2 * live[v] <= VERTEX_CACHE_SIZE ? time - cacheTime[v] : 0;
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    fan = v;
+                }
+            }
+
+            // Dead end, go back to recently used vertices first and scan for any live one last
+            while (fan < 0 && !deadEnd.empty()) {
+                unsigned int v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0) fan = v;
+            }
+            while (fan < 0 && cursor < VertexCount) {
+                if (live[cursor] > 0) fan = cursor;
+                cursor++;
+            }
+        }
+
+        std::copy(result.begin(), result.end(), Indices);
+    }
+
+    glm::vec3 AreaWeightedCentroid(const unsigned int* Indices, size_t IndexCount, const std::vector<VtxData>& Vertices)
+    {
+        glm::vec3 sum(0.0f);
+        float area = 0.0f;
+
+        for (size_t i = 0; i + 2 < IndexCount; i += 3)
+        {
+            const glm::vec3& a = Vertices[Indices[i + 0]].Position;
+            const glm::vec3& b = Vertices[Indices[i + 1]].Position;
+            const glm::vec3& c = Vertices[Indices[i + 2]].Position;
+
+            float triangleArea = glm::length(glm::cross(b - a, c - a));
+            sum  += (a + b + c) * (triangleArea / 3.0f);
+            area += triangleArea;
+        }
+
+        return area > 0.0f ? sum / area : glm::vec3(0.0f);
+    }
+
+    // How far a cluster faces out from the mesh center, clusters that can occlude
+    // the rest of the mesh get the largest keys
+    float OverdrawKey(const unsigned int* Indices, size_t IndexCount, const std::vector<VtxData>& Vertices, const glm::vec3& MeshCentroid)
+    {
+        glm::vec3 normal(0.0f);
+        for (size_t i = 0; i + 2 < IndexCount; i += 3)
+        {
+            const glm::vec3& a = Vertices[Indices[i + 0]].Position;
+            const glm::vec3& b = Vertices[Indices[i + 1]].Position;
+            const glm::vec3& c = Vertices[Indices[i + 2]].Position;
+            normal += glm::cross(b - a, c - a);
+        }
+
+        float length = glm::length(normal);
+        if (length == 0.0f) return 0.0f;
+
+        return glm::dot(AreaWeightedCentroid(Indices, IndexCount, Vertices) - MeshCentroid, normal / length);
+    }
+
+    void OptimizeOverdraw(unsigned int* Indices, size_t IndexCount, const std::vector<VtxData>& Vertices, float Threshold)
+    {
+        size_t triangleCount = IndexCount / 3;
+        if (triangleCount < 2) return;
+
+        // Hard boundaries wherever the cache optimized order restarted, all three vertices missed
+        CacheSimulation cache(Vertices.size());
+        std::vector<size_t> hard = { 0 };
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            int misses = cache.Miss(Indices[t * 3]) + cache.Miss(Indices[t * 3 + 1]) + cache.Miss(Indices[t * 3 + 2]);
+            if (t > 0 && misses == 3) hard.push_back(t);
+        }
+        hard.push_back(triangleCount);
+
+        // Soft boundaries inside them, a new cluster starts as soon as the running
+        // ACMR is back within Threshold of the whole hard cluster's
+        std::vector<size_t> clusters;
+        for (size_t h = 0; h + 1 < hard.size(); h++)
+        {
+            size_t start = hard[h];
+            size_t end   = hard[h + 1];
+
+            cache.Flush();
+            size_t clusterMisses = 0;
+            for (size_t i = start * 3; i < end * 3; i++) clusterMisses += cache.Miss(Indices[i]);
+            float target = Threshold * float(clusterMisses) / float(end - start);
+
+            cache.Flush();
+            clusters.push_back(start);
+            size_t softStart = start;
+            size_t misses    = 0;
+
+            for (size_t t = start; t < end; t++)
+            {
+                misses += cache.Miss(Indices[t * 3]) + cache.Miss(Indices[t * 3 + 1]) + cache.Miss(Indices[t * 3 + 2]);
+
+                if (t + 1 < end && float(misses) <= target * float(t + 1 - softStart)) {
+                    clusters.push_back(t + 1);
+                    softStart = t + 1;
+                    misses    = 0;
+                    cache.Flush();
+                }
+            }
+        }
+        clusters.push_back(triangleCount);
+
+        glm::vec3 centroid = AreaWeightedCentroid(Indices, triangleCount * 3, Vertices);
+
+        size_t clusterCount = clusters.size() - 1;
+        std::vector<float> keys(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+            keys[c] = OverdrawKey(&Indices[clusters[c] * 3], (clusters[c + 1] - clusters[c]) * 3, Vertices, centroid);
+
+        std::vector<size_t> order(clusterCount);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+        std::vector<unsigned int> result;
+        result.reserve(triangleCount * 3);
+        for (size_t c : order)
+            result.insert(result.end(), &Indices[clusters[c] * 3], &Indices[clusters[c + 1] * 3]);
+
+        std::copy(result.begin(), result.end(), Indices);
+    }
+
+    void OptimizeMeshlets(MeshData& Data)
+    {
+        if (Data.Meshlets.empty()) return;
+
+        // Meshlets only touch a handful of vertices, optimize each on a local numbering
+        std::vector<int>          local(Data.VertexData.size(), -1);
+        std::vector<unsigned int> globals;
+        std::vector<unsigned int> localIndices;
+
+        for (const Meshlet& meshlet : Data.Meshlets)
+        {
+            unsigned int* indices = &Data.Indices[meshlet.FirstIndex];
+
+            globals.clear();
+            localIndices.resize(meshlet.IndexCount);
+            for (unsigned int i = 0; i < meshlet.IndexCount; i++)
+            {
+                unsigned int v = indices[i];
+                if (local[v] < 0) {
+                    local[v] = globals.size();
+                    globals.push_back(v);
+                }
+                localIndices[i] = local[v];
+            }
+
+            OptimizeVertexCache(localIndices.data(), localIndices.size(), globals.size());
+
+            for (unsigned int i = 0; i < meshlet.IndexCount; i++) indices[i] = globals[localIndices[i]];
+            for (unsigned int v : globals) local[v] = -1;
+        }
+
+        // The meshlets are the overdraw clusters of LOD 0, sorting them keeps every meshlet contiguous
+        unsigned int lodIndexCount = Data.LODs.empty() ? Data.Indices.size() : Data.LODs[0].IndexCount;
+        glm::vec3 centroid = AreaWeightedCentroid(Data.Indices.data(), lodIndexCount, Data.VertexData);
+
+        std::vector<float> keys(Data.Meshlets.size());
+        for (size_t m = 0; m < Data.Meshlets.size(); m++)
+            keys[m] = OverdrawKey(&Data.Indices[Data.Meshlets[m].FirstIndex], Data.Meshlets[m].IndexCount, Data.VertexData, centroid);
+
+        std::vector<size_t> order(Data.Meshlets.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+        std::vector<unsigned int> indices;
+        std::vector<Meshlet>      meshlets;
+        indices.reserve(lodIndexCount);
+        meshlets.reserve(Data.Meshlets.size());
+
+        for (size_t m : order)
+        {
+            Meshlet meshlet = Data.Meshlets[m];
+            auto first = Data.Indices.begin() + meshlet.FirstIndex;
+
+            meshlet.FirstIndex = indices.size();
+            indices.insert(indices.end(), first, first + meshlet.IndexCount);
+            meshlets.push_back(meshlet);
+        }
+
+        std::copy(indices.begin(), indices.end(), Data.Indices.begin());
+        Data.Meshlets = std::move(meshlets);
+    }
+
+    void OptimizeVertexFetch(MeshData& Data)
+    {
+        std::vector<unsigned int> remap(Data.VertexData.size(), UINT32_MAX);
+        std::vector<VtxData> vertices;
+        vertices.reserve(Data.VertexData.size());
+
+        for (unsigned int& index : Data.Indices)
+        {
+            if (remap[index] == UINT32_MAX) {
+                remap[index] = vertices.size();
+                vertices.push_back(Data.VertexData[index]);
+            }
+            index = remap[index];
+        }
+
+        Data.VertexData = std::move(vertices);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+#include "../asset_manager.h"
+
+namespace AM::Geometry
+{
+    // Post-transform cache the orderings below are tuned for and ACMR is measured with
+    inline constexpr int VERTEX_CACHE_SIZE = 16;
+
+    // Average cache miss ratio of a FIFO cache, transformed vertices per triangle (0.5 to 3)
+    float ACMR(const unsigned int* Indices, size_t IndexCount, size_t VertexCount);
+
+    // Tipsify, reorders the triangles of the range for the post-transform cache
+    void OptimizeVertexCache(unsigned int* Indices, size_t IndexCount, size_t VertexCount);
+
+    // Splits cache optimized triangles into clusters and sorts them so outward facing ones are
+    // drawn first. Clusters are only split where the ACMR stays within Threshold of the original.
+    void OptimizeOverdraw(unsigned int* Indices, size_t IndexCount, const std::vector<VtxData>& Vertices, float Threshold = 1.05f);
+
+    // Cache optimizes every meshlet on its own, then orders the meshlets for overdraw
+    void OptimizeMeshlets(MeshData& Data);
+
+    // Renumbers vertices in order of first use so fetches walk the vertex buffer linearly,
+    // unreferenced vertices are dropped
+    void OptimizeVertexFetch(MeshData& Data);
+}
\ No newline at end of file
@@ -0,0 +1,330 @@
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+#include "simplify.h"
+
+namespace AM::Geometry
+{
+    static_assert(sizeof(VtxData) == 8 * sizeof(float), "Vertex hashing expects tightly packed VtxData");
+
+    // Below this a mesh is cheaper to draw than to switch LODs for
+    constexpr size_t MIN_LOD_TRIANGLES = 64;
+
+    template <size_t N>
+    size_t HashFloats(const float* values)
+    {
+        uint32_t bits[N];
+        std::memcpy(bits, values, sizeof(bits));
+
+        size_t hash = 0;
+        for (uint32_t b : bits) hash ^= b + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+
+    struct VertexHash
+    {
+        size_t operator()(const VtxData& v) const { return HashFloats<8>(&v.Position.x); }
+    };
+
+    struct VertexEqual
+    {
+        bool operator()(const VtxData& a, const VtxData& b) const { return std::memcmp(&a, &b, sizeof(VtxData)) == 0; }
+    };
+
+    struct PositionHash
+    {
+        size_t operator()(const glm::vec3& p) const { return HashFloats<3>(&p.x); }
+    };
+
+    std::vector<unsigned int> PositionRemap(const std::vector<VtxData>& Vertices)
+    {
+        std::vector<unsigned int> remap(Vertices.size());
+        std::unordered_map<glm::vec3, unsigned int, PositionHash> firstAt;
+        firstAt.reserve(Vertices.size());
+
+        for (unsigned int v = 0; v < Vertices.size(); v++)
+            remap[v] = firstAt.try_emplace(Vertices[v].Position, v).first->second;
+
+        return remap;
+    }
+
+    MeshData WeldVertices(const std::vector<VtxData>& Vertices)
+    {
+        MeshData data;
+        data.Indices.reserve(Vertices.size());
+
+        std::unordered_map<VtxData, unsigned int, VertexHash, VertexEqual> unique;
+        unique.reserve(Vertices.size());
+
+        for (const VtxData& v : Vertices)
+        {
+            auto [it, inserted] = unique.try_emplace(v, (unsigned int)data.VertexData.size());
+            if (inserted) data.VertexData.push_back(v);
+            data.Indices.push_back(it->second);
+        }
+
+        return data;
+    }
+
+    // Symmetric 4x4 plane quadric, Weight is the summed triangle area so
+    // Eval returns a mean squared distance instead of growing with tessellation
+    struct Quadric
+    {
+        double a2 = 0, ab = 0, ac = 0, ad = 0;
+        double b2 = 0, bc = 0, bd = 0;
+        double c2 = 0, cd = 0;
+        double d2 = 0;
+        double Weight = 0;
+
+        void AddPlane(const glm::dvec3& n, double d, double w)
+        {
+            a2 += w * n.x * n.x; ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+            b2 += w * n.y * n.y; bc += w * n.y * n.z; bd += w * n.y * d;
+            c2 += w * n.z * n.z; cd += w * n.z * d;
+            d2 += w * d * d;
+            Weight += w;
+        }
+
+        void Add(const Quadric& q)
+        {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+            b2 += q.b2; bc += q.bc; bd += q.bd;
+            c2 += q.c2; cd += q.cd;
+            d2 += q.d2;
+            Weight += q.Weight;
+        }
+
+        double Eval(const glm::dvec3& p) const
+        {
+            if (Weight <= 0.0) return 0.0;
+
+            double e = a2 * p.x * p.x + b2 * p.y * p.y + c2 * p.z * p.z
+                     + 2.0 * (ab * p.x * p.y + ac * p.x * p.z + bc * p.y * p.z)
+                     + 2.0 * (ad * p.x + bd * p.y + cd * p.z)
+                     + d2;
+            return std::abs(e) / Weight;
+        }
+    };
+
+    struct Collapse
+    {
+        unsigned int From;
+        unsigned int To;
+        double       Cost;
+    };
+
+    std::vector<unsigned int> Simplify(const std::vector<VtxData>& Vertices, const std::vector<unsigned int>& Indices,
+                                       size_t TargetIndexCount, float& ResultError)
+    {
+        ResultError = 0.0f;
+        std::vector<unsigned int> result = Indices;
+
+        size_t vertexCount = Vertices.size();
+        if (result.size() <= TargetIndexCount || vertexCount == 0) return result;
+
+        // Vertices sharing a position collapse as one. Every corner later picks the
+        // render vertex at the new position with the closest normal, so hard edges survive.
+        std::vector<unsigned int> canonical = PositionRemap(Vertices);
+        std::vector<unsigned int> wedgeNext(vertexCount);
+        for (unsigned int v = 0; v < vertexCount; v++)
+        {
+            unsigned int c = canonical[v];
+            wedgeNext[v] = c == v ? v : wedgeNext[c];
+            if (c != v) wedgeNext[c] = v;
+        }
+
+        auto position = [&](unsigned int v) { return glm::dvec3(Vertices[v].Position); };
+
+        std::vector<Quadric> quadrics(vertexCount);
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            unsigned int a = canonical[result[i]], b = canonical[result[i + 1]], c = canonical[result[i + 2]];
+            glm::dvec3 n = glm::cross(position(b) - position(a), position(c) - position(a));
+            double length = glm::length(n);
+            if (length == 0.0) continue;
+
+            n /= length;
+            double d = -glm::dot(n, position(a));
+            for (unsigned int v : { a, b, c }) quadrics[v].AddPlane(n, d, length * 0.5);
+        }
+
+        // Open borders and non-manifold edges stay put, moving them would tear or shrink the mesh
+        std::vector<uint8_t> locked(vertexCount, 0);
+        {
+            std::unordered_map<uint64_t, int> edgeUses;
+            edgeUses.reserve(result.size());
+
+            for (size_t i = 0; i < result.size(); i += 3)
+                for (int e = 0; e < 3; e++)
+                {
+                    unsigned int a = canonical[result[i + e]], b = canonical[result[i + (e + 1) % 3]];
+                    edgeUses[((uint64_t)std::min(a, b) << 32) | std::max(a, b)]++;
+                }
+
+            for (const auto& [edge, uses] : edgeUses)
+                if (uses != 2) {
+                    locked[edge >> 32]        = 1;
+                    locked[edge & 0xffffffff] = 1;
+                }
+        }
+
+        auto pickWedge = [&](unsigned int target, const glm::vec3& normal)
+        {
+            unsigned int best = target;
+            float bestDot = -std::numeric_limits<float>::max();
+            unsigned int v = target;
+            do {
+                float d = glm::dot(Vertices[v].Normal, normal);
+                if (d > bestDot) { bestDot = d; best = v; }
+                v = wedgeNext[v];
+            } while (v != target);
+            return best;
+        };
+
+        std::vector<Collapse>     collapses;
+        std::vector<unsigned int> adjacencyOffsets(vertexCount + 1);
+        std::vector<unsigned int> adjacency;
+        std::vector<uint8_t>      touched(vertexCount);
+
+        size_t triangleCount   = result.size() / 3;
+        size_t targetTriangles = TargetIndexCount / 3;
+        double maxError        = 0.0;
+
+        while (triangleCount > targetTriangles)
+        {
+            // Interior edges show up once per winding, keeping a < b visits each once
+            collapses.clear();
+            for (size_t i = 0; i < result.size(); i += 3)
+                for (int e = 0; e < 3; e++)
+                {
+                    unsigned int a = canonical[result[i + e]], b = canonical[result[i + (e + 1) % 3]];
+                    if (a >= b || (locked[a] && locked[b])) continue;
+
+                    Quadric q = quadrics[a];
+                    q.Add(quadrics[b]);
+
+                    double costAB = locked[a] ? std::numeric_limits<double>::max() : q.Eval(position(b));
+                    double costBA = locked[b] ? std::numeric_limits<double>::max() : q.Eval(position(a));
+
+                    if (costAB <= costBA) collapses.push_back({ a, b, costAB });
+                    else                  collapses.push_back({ b, a, costBA });
+                }
+
+            if (collapses.empty()) break;
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.Cost < y.Cost; });
+
+            // Triangles around every canonical vertex, valid for this pass since
+            // everything a collapse modifies gets touched and skipped afterwards
+            std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+            for (unsigned int index : result) adjacencyOffsets[canonical[index] + 1]++;
+            for (size_t v = 0; v < vertexCount; v++) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+            adjacency.resize(result.size());
+            std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < result.size(); i++) adjacency[fill[canonical[result[i]]]++] = i / 3;
+
+            std::fill(touched.begin(), touched.end(), 0);
+            size_t budget  = triangleCount - targetTriangles;
+            size_t removed = 0;
+            size_t applied = 0;
+
+            for (const Collapse& collapse : collapses)
+            {
+                if (removed >= budget) break;
+                if (touched[collapse.From] || touched[collapse.To]) continue;
+
+                // Reject collapses that would fold a surrounding triangle over
+                bool flips = false;
+                size_t degenerate = 0;
+                for (unsigned int k = adjacencyOffsets[collapse.From]; k < adjacencyOffsets[collapse.From + 1] && !flips; k++)
+                {
+                    const unsigned int* tri = &result[adjacency[k] * 3];
+                    glm::dvec3 p[3], q[3];
+                    bool hasTo = false;
+
+                    for (int c = 0; c < 3; c++) {
+                        unsigned int v = canonical[tri[c]];
+                        hasTo |= v == collapse.To;
+                        p[c] = position(v);
+                        q[c] = v == collapse.From ? position(collapse.To) : p[c];
+                    }
+                    if (hasTo) {
+                        degenerate++;
+                        continue;
+                    }
+
+                    glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    glm::dvec3 after  = glm::cross(q[1] - q[0], q[2] - q[0]);
+                    flips = glm::dot(before, after) <= 0.0;
+                }
+                if (flips) continue;
+
+                for (unsigned int k = adjacencyOffsets[collapse.From]; k < adjacencyOffsets[collapse.From + 1]; k++)
+                {
+                    unsigned int* tri = &result[adjacency[k] * 3];
+                    for (int c = 0; c < 3; c++)
+                    {
+                        if (canonical[tri[c]] == collapse.From)
+                            tri[c] = pickWedge(collapse.To, Vertices[tri[c]].Normal);
+                        touched[canonical[tri[c]]] = 1;
+                    }
+                }
+
+                touched[collapse.From] = 1;
+                quadrics[collapse.To].Add(quadrics[collapse.From]);
+                maxError = std::max(maxError, collapse.Cost);
+                removed += degenerate;
+                applied++;
+            }
+
+            if (applied == 0) break;
+
+            // Drop the triangles that collapsed into lines
+            size_t write = 0;
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                unsigned int a = canonical[result[i]], b = canonical[result[i + 1]], c = canonical[result[i + 2]];
+                if (a == b || b == c || a == c) continue;
+
+                result[write++] = result[i];
+                result[write++] = result[i + 1];
+                result[write++] = result[i + 2];
+            }
+            result.resize(write);
+            triangleCount = write / 3;
+        }
+
+        ResultError = (float)std::sqrt(maxError);
+        return result;
+    }
+
+    void GenerateLODs(MeshData& Data)
+    {
+        Data.LODs.clear();
+        Data.LODs.push_back({ 0, (unsigned int)Data.Indices.size(), 0.0f });
+
+        std::vector<unsigned int> current = Data.Indices;
+        float error = 0.0f;
+
+        for (int lod = 1; lod < MAX_LODS; lod++)
+        {
+            if (current.size() / 3 < MIN_LOD_TRIANGLES) break;
+
+            float lodError;
+            std::vector<unsigned int> simplified = Simplify(Data.VertexData, current, current.size() / 6 * 3, lodError);
+
+            // Stuck on locked borders, another level would barely save anything
+            if (simplified.size() * 10 > current.size() * 9) break;
+
+            // Every level is simplified from the previous one, so errors add up
+            error += lodError;
+            Data.LODs.push_back({ (unsigned int)Data.Indices.size(), (unsigned int)simplified.size(), error });
+            Data.Indices.insert(Data.Indices.end(), simplified.begin(), simplified.end());
+            current = std::move(simplified);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+
+#include "../asset_manager.h"
+
+namespace AM::Geometry
+{
+    inline constexpr int MAX_LODS = 4;
+
+    // First vertex with the same position for every vertex, shared by seams in normals
+    std::vector<unsigned int> PositionRemap(const std::vector<VtxData>& Vertices);
+
+    // Merges bitwise identical vertices of a triangle soup into an indexed mesh
+    MeshData WeldVertices(const std::vector<VtxData>& Vertices);
+
+    // Quadric error edge collapse down to TargetIndexCount or as far as it gets,
+    // vertices are never moved so the result indexes the same vertex buffer.
+    // ResultError is the largest deviation introduced, in object space units.
+    std::vector<unsigned int> Simplify(const std::vector<VtxData>& Vertices, const std::vector<unsigned int>& Indices,
+                                       size_t TargetIndexCount, float& ResultError);
+
+    // Appends up to MAX_LODS - 1 simplified index ranges after LOD 0
+    void GenerateLODs(MeshData& Data);
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include <cmath>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+#include <glad/glad.h>
+#include "../asset_manager.h"
+
+namespace AM::IO
+{
+    // Fixed part of a KTX2 header, followed by one LevelIndex per level
+    struct Ktx2Header
+    {
+        uint8_t  Identifier[12];
+        uint32_t VkFormat;
+        uint32_t TypeSize;
+        uint32_t PixelWidth;
+        uint32_t PixelHeight;
+        uint32_t PixelDepth;
+        uint32_t LayerCount;
+        uint32_t FaceCount;
+        uint32_t LevelCount;
+        uint32_t SupercompressionScheme;
+        uint32_t DfdByteOffset;
+        uint32_t DfdByteLength;
+        uint32_t KvdByteOffset;
+        uint32_t KvdByteLength;
+        uint64_t SgdByteOffset;
+        uint64_t SgdByteLength;
+    };
+
+    struct Ktx2LevelIndex
+    {
+        uint64_t ByteOffset;
+        uint64_t ByteLength;
+        uint64_t UncompressedByteLength;
+    };
+
+    static const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    // VkFormat values of the formats the loader takes
+    enum VkFormat : uint32_t
+    {
+        VK_FORMAT_R8G8B8A8_UNORM  = 37,
+        VK_FORMAT_R8G8B8A8_SRGB   = 43,
+        VK_FORMAT_BC7_UNORM_BLOCK = 145,
+        VK_FORMAT_BC7_SRGB_BLOCK  = 146,
+    };
+
+    // Halves an RGBA8 level, odd edges repeat their last texel
+    std::vector<unsigned char> DownsampleRGBA8(const std::vector<unsigned char>& Src, int Width, int Height)
+    {
+        int w = std::max(Width / 2, 1);
+        int h = std::max(Height / 2, 1);
+        std::vector<unsigned char> dst((size_t)w * h * 4);
+
+        for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+        {
+            int x0 = std::min(x * 2, Width - 1),  x1 = std::min(x * 2 + 1, Width - 1);
+            int y0 = std::min(y * 2, Height - 1), y1 = std::min(y * 2 + 1, Height - 1);
+            for (int c = 0; c < 4; c++)
+            {
+                int sum = Src[((size_t)y0 * Width + x0) * 4 + c] + Src[((size_t)y0 * Width + x1) * 4 + c] +
+                          Src[((size_t)y1 * Width + x0) * 4 + c] + Src[((size_t)y1 * Width + x1) * 4 + c];
+                dst[((size_t)y * w + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+        return dst;
+    }
+
+    TextureData LoadKtx2File(const std::string& Path)
+    {
+        std::ifstream file(Path, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open KTX2: " + Path);
+        }
+
+        Ktx2Header header;
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || std::memcmp(header.Identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+            throw std::runtime_error("Not a KTX2 file: " + Path);
+        }
+        if (header.SupercompressionScheme != 0 || header.PixelDepth > 1 || header.LayerCount > 1 || header.FaceCount != 1) {
+            throw std::runtime_error("Unsupported KTX2 layout (supercompressed, 3D, array or cube): " + Path);
+        }
+
+        TextureData texture;
+        texture.Width  = (int)header.PixelWidth;
+        texture.Height = (int)header.PixelHeight;
+        switch (header.VkFormat) {
+            case VK_FORMAT_R8G8B8A8_UNORM:  texture.Format = GL_RGBA8;                            break;
+            case VK_FORMAT_R8G8B8A8_SRGB:   texture.Format = GL_SRGB8_ALPHA8;                     break;
+            case VK_FORMAT_BC7_UNORM_BLOCK: texture.Format = GL_COMPRESSED_RGBA_BPTC_UNORM;       break;
+            case VK_FORMAT_BC7_SRGB_BLOCK:  texture.Format = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM; break;
+
+            default: throw std::runtime_error("Unsupported KTX2 format " + std::to_string(header.VkFormat) + ": " + Path);
+        }
+        texture.Compressed = header.VkFormat == VK_FORMAT_BC7_UNORM_BLOCK || header.VkFormat == VK_FORMAT_BC7_SRGB_BLOCK;
+
+        // Level count 0 asks the loader to generate the chain
+        uint32_t levelCount = std::max(header.LevelCount, 1u);
+        std::vector<Ktx2LevelIndex> levels(levelCount);
+        file.read(reinterpret_cast<char*>(levels.data()), levelCount * sizeof(Ktx2LevelIndex));
+
+        texture.Mips.resize(levelCount);
+        for (uint32_t i = 0; i < levelCount; i++)
+        {
+            texture.Mips[i].resize(levels[i].ByteLength);
+            file.seekg(levels[i].ByteOffset);
+            file.read(reinterpret_cast<char*>(texture.Mips[i].data()), levels[i].ByteLength);
+        }
+        if (!file) {
+            throw std::runtime_error("Truncated KTX2: " + Path);
+        }
+
+        int fullChain = (int)std::floor(std::log2((float)std::max(texture.Width, texture.Height))) + 1;
+        if (!texture.Compressed)
+        {
+            int w = texture.Width, h = texture.Height;
+            for (int i = 1; i < (int)texture.Mips.size(); i++) { w = std::max(w / 2, 1); h = std::max(h / 2, 1); }
+            while ((int)texture.Mips.size() < fullChain)
+            {
+                texture.Mips.push_back(DownsampleRGBA8(texture.Mips.back(), w, h));
+                w = std::max(w / 2, 1);
+                h = std::max(h / 2, 1);
+            }
+        }
+
+        return texture;
+    }
+}
@@ -151,7 +151,8 @@ namespace AM::IO
                     for (int idx : {0, (int)k, (int)(k+1)}) {
                         VtxData vert{};
                         vert.Position = positions[vi[idx]];
-                        // if (ti[idx] >= 0) vert.uv = uvs[ti[idx]];
+                        // OBJ v runs up, textures are uploaded top row first
+                        if (ti[idx] >= 0) vert.TexCoord = glm::vec2(uvs[ti[idx]].x, 1.0f - uvs[ti[idx]].y);
                         if (ni[idx] >= 0) vert.Normal = normals[ni[idx]];
                         vertices.push_back(vert);
                     }
@@ -172,8 +173,12 @@ namespace AM::IO
         std::thread([path, meshName]
             {
             auto vertices = LoadObjFile(path);
-            qk::PostFunctionToMainThread([v = std::move(vertices), meshName] {
-                AM::AddMeshByData(v, meshName);
+
+            // Only the pool upload needs the main thread
+            AM::MeshData data;
+            AM::Mesh mesh(vertices, data);
+            qk::PostFunctionToMainThread([mesh = std::move(mesh), data = std::move(data), meshName]() mutable {
+                AM::AddPreparedMesh(std::move(mesh), data, meshName);
             });
         }).detach();
     }
@@ -192,8 +197,10 @@ namespace AM::IO
 
                 // Compose mesh name using prefix and file stem
                 std::string meshName = meshNamePrefix + "_" + entry.path().stem().string();
-                qk::PostFunctionToMainThread([v = std::move(vertices), meshName]() mutable {
-                    AM::AddMeshByData(v, meshName);
+                AM::MeshData data;
+                AM::Mesh mesh(vertices, data);
+                qk::PostFunctionToMainThread([mesh = std::move(mesh), data = std::move(data), meshName]() mutable {
+                    AM::AddPreparedMesh(std::move(mesh), data, meshName);
                 });
             }
         }).detach();
@@ -0,0 +1,118 @@
+#include <memory>
+
+#include <glad/glad.h>
+
+#include "ambient_occlusion.h"
+#include "../render_engine.h"
+#include "../deferred/deffered_manager.h"
+
+namespace SSAO
+{
+    void ReloadShaders();
+    void Resize(glm::ivec2 SourceSize);
+
+    std::unique_ptr<Shader> S_ssao;
+    std::unique_ptr<Shader> S_ssaoBlur;
+
+    // Occlusion in r and view depth in g for the bilateral weights, blurred through _scratch and back
+    unsigned int _occlusion;
+    unsigned int _scratch;
+    glm::ivec2   _sourceSize(0);
+    glm::ivec2   _size(0);
+    unsigned int _frame = 0;
+
+    // After the G-buffers and the cascades
+    const int TEXTURE_UNIT = 9;
+
+    void Initialize()
+    {
+        Engine::RegisterEditorReloadShadersFunction(ReloadShaders);
+
+        S_ssao     = std::make_unique<Shader>("/res/shaders/lighting/ssao");
+        S_ssaoBlur = std::make_unique<Shader>("/res/shaders/lighting/ssao_blur");
+
+        glGenTextures(1, &_occlusion);
+        glGenTextures(1, &_scratch);
+
+        // A texel until the first Compute, so shading can always bind it
+        Resize(glm::ivec2(1));
+    }
+
+    void Resize(glm::ivec2 SourceSize)
+    {
+        _sourceSize = SourceSize;
+        _size       = glm::max((SourceSize + 1) / 2, glm::ivec2(1));
+
+        for (unsigned int texture : { _occlusion, _scratch })
+        {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, _size.x, _size.y, 0, GL_RG, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+    }
+
+    void Compute(unsigned int DepthTexture, unsigned int NormalTexture, bool PackedNormals)
+    {
+        if (!Enabled) return;
+
+        // Follows the G-buffers through dynamic resolution changes
+        glm::ivec2 depthSize;
+        glGetTextureLevelParameteriv(DepthTexture, 0, GL_TEXTURE_WIDTH,  &depthSize.x);
+        glGetTextureLevelParameteriv(DepthTexture, 0, GL_TEXTURE_HEIGHT, &depthSize.y);
+        if (depthSize != _sourceSize) Resize(depthSize);
+
+        glm::ivec2 groups = (_size + 7) / 8;
+
+        S_ssao->Use();
+        S_ssao->SetInt("GDepth", 0);
+        S_ssao->SetInt("GNormal", 1);
+        S_ssao->SetInt("packedGBuffer", PackedNormals);
+        S_ssao->SetFloat("radius", Radius);
+        S_ssao->SetFloat("intensity", Intensity);
+        // Rotating the pattern only pays off when TAA accumulates it
+        S_ssao->SetInt("frame", Deferred::TemporalAA ? int(_frame++ % 64) : 0);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, DepthTexture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, NormalTexture);
+
+        glBindImageTexture(0, _occlusion, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+        glDispatchCompute(groups.x, groups.y, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        S_ssaoBlur->Use();
+        S_ssaoBlur->SetInt("source", 0);
+        glActiveTexture(GL_TEXTURE0);
+
+        glBindTexture(GL_TEXTURE_2D, _occlusion);
+        glBindImageTexture(0, _scratch, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+        S_ssaoBlur->SetBool("vertical", false);
+        glDispatchCompute(groups.x, groups.y, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+        glBindTexture(GL_TEXTURE_2D, _scratch);
+        glBindImageTexture(0, _occlusion, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+        S_ssaoBlur->SetBool("vertical", true);
+        glDispatchCompute(groups.x, groups.y, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    void ReloadShaders()
+    {
+        S_ssao->Reload();
+        S_ssaoBlur->Reload();
+    }
+
+    void Bind(Shader& S)
+    {
+        S.SetInt("ssaoEnabled", Enabled);
+
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, _occlusion);
+        S.SetInt("SSAO", TEXTURE_UNIT);
+    }
+}
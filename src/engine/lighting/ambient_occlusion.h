@@ -0,0 +1,23 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "../../common/shader.h"
+
+namespace SSAO
+{
+    // Screen-space ambient occlusion of the G-buffer at half the render resolution, 8 samples per
+    // pixel on a per-pixel rotated disk, a separable bilateral blur and a depth-aware upsample where
+    // shading reads it. Radius is in view space units
+    inline bool  Enabled   = true;
+    inline float Radius    = 0.5f;
+    inline float Intensity = 1.0f;
+
+    void Initialize();
+
+    // Reallocates when the depth texture changes size, GNormal is decoded as packed when PackedNormals
+    void Compute(unsigned int DepthTexture, unsigned int NormalTexture, bool PackedNormals);
+
+    // Binds the occlusion and sets the ssao uniforms of a shading shader
+    void Bind(Shader& S);
+}
@@ -0,0 +1,99 @@
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "lighting.h"
+#include "../render_engine.h"
+#include "../scene_manager.h"
+
+namespace Lighting
+{
+    void ReloadShaders();
+
+    std::unique_ptr<Shader> S_clusterLights;
+
+    unsigned int _lightSSBO;
+    unsigned int _gridSSBO;
+    unsigned int _indexSSBO;
+
+    std::vector<PointLightData> _lights;
+
+    // Depth range of the grid, taken from the projection of the last CullLights
+    float _near = 0.1f;
+    float _far  = 1000.0f;
+
+    void Initialize()
+    {
+        Engine::RegisterEditorReloadShadersFunction(ReloadShaders);
+
+        S_clusterLights = std::make_unique<Shader>("/res/shaders/lighting/cluster_lights");
+
+        glGenBuffers(1, &_lightSSBO);
+        glGenBuffers(1, &_gridSSBO);
+        glGenBuffers(1, &_indexSSBO);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _lightSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(PointLightData), nullptr, GL_DYNAMIC_DRAW);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _gridSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * sizeof(unsigned int), nullptr, GL_DYNAMIC_COPY);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _indexSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (size_t)CLUSTER_COUNT * MAX_CLUSTER_LIGHTS * sizeof(unsigned int), nullptr, GL_DYNAMIC_COPY);
+    }
+
+    void ReloadShaders()
+    {
+        S_clusterLights->Reload();
+    }
+
+    void UploadLights()
+    {
+        _lights.clear();
+        for (SM::SceneNode* node : SM::SceneNodes)
+        {
+            SM::Light* light = dynamic_cast<SM::Light*>(node);
+            if (!light) continue;
+
+            _lights.push_back({ light->GetPosition(), light->GetRadius(), light->GetColor(), light->GetIntensity() });
+        }
+        NumLights = (int)_lights.size();
+
+        // Orphaned every frame, never left empty so the binding stays valid
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _lightSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(_lights.size(), 1) * sizeof(PointLightData), nullptr, GL_DYNAMIC_DRAW);
+        if (!_lights.empty()) glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, _lights.size() * sizeof(PointLightData), _lights.data());
+    }
+
+    void CullLights(const glm::mat4& Proj)
+    {
+        UploadLights();
+
+        // Planes of a standard OpenGL perspective projection
+        _near = Proj[3][2] / (Proj[2][2] - 1.0f);
+        _far  = Proj[3][2] / (Proj[2][2] + 1.0f);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, _lightSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, _gridSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, _indexSSBO);
+
+        S_clusterLights->Use();
+        S_clusterLights->SetFloat("zNear", _near);
+        S_clusterLights->SetFloat("zFar",  _far);
+        S_clusterLights->SetInt("numLights", NumLights);
+        glDispatchCompute((CLUSTER_COUNT + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    void BindClusters(Shader& S)
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, _lightSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, _gridSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, _indexSSBO);
+
+        S.SetFloat("zNear", _near);
+        S.SetFloat("zFar",  _far);
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "../../common/shader.h"
+
+namespace Lighting
+{
+    // Froxel grid over the camera frustum, screen tiles times exponentially spaced depth slices.
+    // Must match res/shaders/lighting/clusters.glsl
+    const int CLUSTERS_X = 16;
+    const int CLUSTERS_Y = 9;
+    const int CLUSTERS_Z = 24;
+    const int CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+
+    // Every cluster owns a fixed range of the index list, lights past it are dropped
+    const int MAX_CLUSTER_LIGHTS = 256;
+
+    // Matches the std430 layout of the PointLights SSBO (binding 12)
+    struct PointLightData
+    {
+        glm::vec3 Position;
+        float     Radius;
+        glm::vec3 Color;
+        float     Intensity;
+    };
+
+    // Point lights uploaded this frame
+    inline int NumLights = 0;
+
+    void Initialize();
+
+    // Gathers the point lights of the scene into the PointLights SSBO, all the tiled path needs
+    void UploadLights();
+
+    // Uploads the lights and bins them by Light::_radius into the
+    // clusters of the camera in the Frame uniforms, Proj only provides the depth range
+    void CullLights(const glm::mat4& Proj);
+
+    // Binds the light, grid and index buffers and sets the grid uniforms of a shading shader
+    void BindClusters(Shader& S);
+}
@@ -11,11 +11,17 @@
 #include "asset_manager.h"
 #include "scene_manager.h"
 #include "deferred/deffered_manager.h"
+#include "culling/culling.h"
+#include "lighting/lighting.h"
+#include "lighting/ambient_occlusion.h"
+#include "textures/textures.h"
 #include "editor/object_manipulation.h"
 #include "editor/light_manipulation.h"
 #include "../common/stat_counter.h"
 #include "../common/input.h"
 #include "../common/qk.h"
+#include "../common/shader.h"
+#include "../common/file_watcher.h"
 #include "../ui/ui.h"
 #include "../ui/text_renderer.h"
 #include <iomanip>
@@ -64,6 +70,18 @@ namespace Engine
         windowResized(window, windowWidth, windowHeight);
     }
 
+    void setDefaultState()
+    {
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // BG color set in shader
+        glLineWidth(2);
+    }
+
     void Initialize()
     {
         std::string OS;
@@ -116,18 +134,17 @@ namespace Engine
             glfwTerminate();
         }
 
-        glEnable(GL_DEPTH_TEST);
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
+        setDefaultState();
 
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // BG color set in shader
-        glLineWidth(2);
+        double initStart = glfwGetTime();
 
         Stats::Initialize();
         Input::Initialize();
         Deferred::Initialize();
+        Culling::Initialize();
+        Lighting::Initialize();
+        SSAO::Initialize();
+        Textures::Initialize();
         SM::Initialize();
         AM::Initialize();
         ObjectManipulation::Initialize();
@@ -136,11 +153,39 @@ namespace Engine
         UI::Initialize();
         qk::Initialize();
 
+        // Compare runs with and without cache/shaders for cold and warm startup
+        Shader::FinishPending();
+        /* EDITOR ONLY */ FileWatcher::Watch(Stats::ProjectPath + "/res/shaders", Shader::SourceChanged);
+        std::cout << std::format("[:] Built {} shaders ({} compiled, {} from cache) in {:.1f} ms\n",
+                                 Shader::Compiled + Shader::Cached, Shader::Compiled, Shader::Cached, Shader::BuildMilliseconds);
+        std::cout << std::format("[:] Initialized in {:.1f} ms\n\n", (glfwGetTime() - initStart) * 1000.0);
+
         windowResized(window, windowWidth, windowHeight);
 
         debugMode = DebugMode::Stats;
     }
 
+    void InitializeHeadless(int Width, int Height)
+    {
+        windowWidth  = Width;
+        windowHeight = Height;
+
+        setDefaultState();
+
+        Stats::Initialize();
+        Deferred::Initialize();
+        Culling::Initialize();
+        Lighting::Initialize();
+        SSAO::Initialize();
+        Textures::Initialize();
+        SM::Initialize();
+        AM::Initialize();
+        qk::Initialize();
+
+        Shader::FinishPending();
+        windowResized(window, windowWidth, windowHeight);
+    }
+
     void Run()
     {
         while (!glfwWindowShouldClose(window)) { NewFrame(); }
@@ -153,6 +198,8 @@ namespace Engine
     float Shading_Timing;
     float PostProcess_Timing;
     float UI_Timing;
+    float Culling_Timing;
+    float SSAO_Timing;
     
     void NewFrame()
     {
@@ -165,66 +212,35 @@ namespace Engine
 
         /* EDITOR ONLY */ if (Input::KeyPressed(GLFW_KEY_X) && Input::GetInputContext() == Input::Game && SM::SceneNodes.size() > 0)
         {
-            SM::SceneNodes.erase(SM::SceneNodes.begin() + SM::GetSelectedIndex());
-            SM::SceneNodeNames.erase(SM::SceneNodeNames.begin() + SM::GetSelectedIndex());
+            SM::RemoveNode(SM::GetSelectedIndex());
             SM::SelectSceneNode(std::max(SM::GetSelectedIndex() - 1, 0));
-            SM::UpdateDrawList();
         }
         
         /* EDITOR ONLY */ qk::ExecuteMainThreadTasks();
+        /* EDITOR ONLY */ Shader::UpdateHotReload();
         /* EDITOR ONLY */ if (Input::KeyPressed(GLFW_KEY_F)) SM::FocusSelection();
         /* EDITOR ONLY */ for (const auto& func : editorEvents) { func(); }
-        /* EDITOR ONLY */ if (Input::KeyPressed(GLFW_KEY_HOME)) for (const auto& func : editorReloadShaderEvents) { func(); }
-        
-        // Make sure this view matrix is from active camera
-        // This should happen after editorEvents
-        AM::ViewMat4 = AM::EditorCam.GetViewMatrix();
-        SM::UpdateInstanceMatrixSSBO();
-        
-        // GBuffers --------------------------
-        glBindFramebuffer(GL_FRAMEBUFFER, Deferred::GetGBufferFBO());
-        qk::BeginGPUTimer("GBuffers");
-        Deferred::DrawGBuffers();
-        /* EDITOR ONLY */ Deferred::DrawMask(); // R8 texture used for outline generation
-        float timing1 = qk::EndGPUTimer("GBuffers");
-        if (timing1 != 0.0f) {
-            GBuffers_Timing = timing1;
-        }
-
-        qk::BeginGPUTimer("Draw Shadows");
-        glBindFramebuffer(GL_FRAMEBUFFER, Deferred::GetShadowFBO());
-        Deferred::DrawShadows();
-        float time_DrawShadows = qk::EndGPUTimer("Draw Shadows");
-        if (time_DrawShadows != 0.0f) {
-            DrawShadows_Timing = time_DrawShadows;
-        }
-
-        qk::BeginGPUTimer("Calc Shadows");
-        glBindFramebuffer(GL_FRAMEBUFFER, Deferred::GetGBufferFBO());
-        Deferred::CalcShadows();
-        float time_CalcShadows = qk::EndGPUTimer("Calc Shadows");
-        if (time_CalcShadows != 0.0f) {
-            CalcShadows_Timing = time_CalcShadows;
-        }
+        /* EDITOR ONLY */ if (Input::KeyPressed(GLFW_KEY_HOME)) { for (const auto& func : editorReloadShaderEvents) { func(); } Shader::FinishPending(); }
+        /* EDITOR ONLY */ if (Input::KeyPressed(GLFW_KEY_F10)) Culling::CullingMode = Culling::Mode((Culling::CullingMode + 1) % 3);
+        /* EDITOR ONLY */ if (Input::KeyPressed(GLFW_KEY_F9))  Deferred::ShadowCaching = !Deferred::ShadowCaching;
+        /* EDITOR ONLY */ if (Input::KeyPressed(GLFW_KEY_F8))  Culling::LayeredShadows = !Culling::LayeredShadows;
+        /* EDITOR ONLY */ if (Input::KeyPressed(GLFW_KEY_F7))  Deferred::SetPackedGBuffer(!Deferred::PackedGBuffer);
+        /* EDITOR ONLY */ if (Input::KeyPressed(GLFW_KEY_F5))  Deferred::SetDynamicResolution(!Deferred::DynamicResolution);
+        /* EDITOR ONLY */ if (Input::KeyPressed(GLFW_KEY_F4))  Deferred::SetTemporalAA(!Deferred::TemporalAA);
+        /* EDITOR ONLY */ if (Input::KeyPressed(GLFW_KEY_F3))  SSAO::Enabled = !SSAO::Enabled;
+        /* EDITOR ONLY */ if (Input::KeyPressed(GLFW_KEY_F6))  Deferred::SetShadowResolve(Deferred::ShadowResolve((Deferred::ShadowResolveMode + 1) % 3));
         
-        // Draw deferred shaded to color attachment 0
-        glDrawBuffer(GL_COLOR_ATTACHMENT0);
-        qk::BeginGPUTimer("Shading");
-        Deferred::DoShading();
-        float time_Shading = qk::EndGPUTimer("Shading");
-        if (time_Shading != 0.0f) {
-            Shading_Timing = time_Shading;
-        }
-        /* EDITOR ONLY */ for (const auto& func : editorDraw3DEvents) { func(); }
-        // -------------------------------------------
+        RenderFrame();
 
         // Display -----------------------------------
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, windowWidth, windowHeight);
         glClear(GL_COLOR_BUFFER_BIT);
 
         glEnable(GL_BLEND);
         glDisable(GL_DEPTH_TEST);
         qk::BeginGPUTimer("Post Process");
+        Deferred::ResolveTemporal();
         Deferred::DoPostProcessAndDisplay();
         float time_PP = qk::EndGPUTimer("Post Process");
         if (time_PP != 0.0f) {
@@ -251,6 +267,48 @@ namespace Engine
             Text::Render(qk::LabelWithPaddedNumber("Shading:", Shading_Timing, 15, 5),             15, y - 26 * 3, 0.5f);
             Text::Render(qk::LabelWithPaddedNumber("Post Process:", PostProcess_Timing, 15, 5),    15, y - 26 * 4, 0.5f);
             Text::Render(qk::LabelWithPaddedNumber("UI:", UI_Timing, 15, 5),                       15, y - 26 * 5, 0.5f);
+            Text::Render(qk::LabelWithPaddedNumber("Culling:", Culling_Timing, 15, 5),             15, y - 26 * 6, 0.5f);
+            Text::Render(qk::LabelWithPaddedNumber("SSAO:", SSAO_Timing, 15, 5),                   15, y - 26 * 7, 0.5f);
+
+            Text::Render(std::format("Culling mode:  {} (F10)", Culling::ModeToString(Culling::CullingMode)), 15, y - 26 * 8, 0.5f);
+            for (int i = 0; i < Culling::NumViews; i++) {
+                const Culling::View& view = Culling::Views[i];
+                std::string label = std::string(Culling::ViewToString(Culling::ViewID(i))) + ":";
+                Text::Render(std::format("{:<15}{:>6} visible {:>6} culled", label, view.Visible, view.Culled), 15, y - 26 * (9 + i), 0.5f);
+            }
+
+            const Culling::View& camera = Culling::Views[Culling::CameraView];
+            float rejected = camera.ClusterTriangles > 0 ? 100.0f * camera.ClusterRejected / camera.ClusterTriangles : 0.0f;
+            Text::Render(std::format("{:<15}{:>5.1f}% of {} triangles rejected", "Clusters:", rejected, qk::FmtK(int(camera.ClusterTriangles))), 15, y - 26 * (9 + Culling::NumViews), 0.5f);
+
+            Text::Render(std::format("Shadow cache:  {} (F9) {} / {} / {}", Deferred::ShadowCaching ? "On" : "Off",
+                                     Deferred::CascadeUpdateToString(0), Deferred::CascadeUpdateToString(1), Deferred::CascadeUpdateToString(2)),
+                         15, y - 26 * (11 + Culling::NumViews), 0.5f);
+            Text::Render(std::format("Shadow pass:   {} (F8)", !Culling::LayeredShadows ? "Per cascade" : Culling::LayerMasks ? "Layered, GS" : "Layered, VS"),
+                         15, y - 26 * (12 + Culling::NumViews), 0.5f);
+            Text::Render(std::format("{:<15}{:>6} in {}x{}x{} clusters", "Point lights:", Lighting::NumLights, Lighting::CLUSTERS_X, Lighting::CLUSTERS_Y, Lighting::CLUSTERS_Z),
+                         15, y - 26 * (13 + Culling::NumViews), 0.5f);
+            int gbufferBytes = Deferred::GBufferBytesPerPixel();
+            Text::Render(std::format("G-buffer:      {} (F7) ~{} B/px, ~{:.1f} / {:.1f} MB per frame at 1080p / 4K", Deferred::PackedGBuffer ? "Packed" : "Wide",
+                                     gbufferBytes, gbufferBytes * 1920.0 * 1080.0 / 1e6, gbufferBytes * 3840.0 * 2160.0 / 1e6),
+                         15, y - 26 * (14 + Culling::NumViews), 0.5f);
+            Text::Render(std::format("Shadow factor: {} (F6)", Deferred::ShadowResolveToString(Deferred::ShadowResolveMode)),
+                         15, y - 26 * (15 + Culling::NumViews), 0.5f);
+            Text::Render(std::format("Shading path:  {} (Debug menu)", Deferred::TiledShading ? "Tiled compute, 16x16" : "Fragment, clustered"),
+                         15, y - 26 * (16 + Culling::NumViews), 0.5f);
+            glm::ivec2 renderSize = Deferred::GetRenderSize();
+            Text::Render(std::format("Resolution:    {}x{} ({:.0f}%) {} (F5), target {:.1f} ms", renderSize.x, renderSize.y, Deferred::RenderScale * 100.0f,
+                                     Deferred::DynamicResolution ? "dynamic" : "fixed", Deferred::TargetFrameMs),
+                         15, y - 26 * (17 + Culling::NumViews), 0.5f);
+            Text::Render(std::format("Temporal AA:   {} (F4)", Deferred::TemporalAA ? "On, 8 jitter phases" : "Off"),
+                         15, y - 26 * (18 + Culling::NumViews), 0.5f);
+            Text::Render(std::format("SSAO:          {} (F3), half resolution, budget 0.5 ms at 1080p", SSAO::Enabled ? "On" : "Off"),
+                         15, y - 26 * (19 + Culling::NumViews), 0.5f);
+            Textures::Residency residency = Textures::GetResidency();
+            Text::Render(std::format("Textures:      {} full res of {}, {} decoding, {:.1f} / {:.1f} MB resident, {:.1f} MB wanted{}",
+                                     residency.Full, residency.Textures, residency.Decoding, residency.ResidentBytes / 1048576.0,
+                                     Textures::BudgetBytes / 1048576.0, residency.WantedBytes / 1048576.0, Textures::Bindless() ? "" : ", no bindless"),
+                         15, y - 26 * (20 + Culling::NumViews), 0.5f);
 
             Stats::DrawStats();
         }
@@ -262,6 +320,89 @@ namespace Engine
         glfwSwapBuffers(window);
     }
 
+    void RenderFrame()
+    {
+        // Make sure this view matrix is from active camera
+        // This should happen after editorEvents
+        AM::ViewMat4 = AM::EditorCam.GetViewMatrix();
+        SM::UpdateInstanceSSBO();
+        SM::UpdateMaterialSSBO();
+        SM::RequestMaterialTextures();
+        Textures::Update();
+
+        // Last measured GPU time of every stage, timers lag a frame or two.
+        // Before the upload, the jitter is sized to the render target
+        Deferred::UpdateRenderScale(Culling_Timing + GBuffers_Timing + DrawShadows_Timing + CalcShadows_Timing + SSAO_Timing + Shading_Timing + PostProcess_Timing + UI_Timing);
+        Deferred::UpdateCascades();
+        Deferred::UploadFrameUniforms();
+
+        // Culling ---------------------------
+        glm::mat4 viewProj[Culling::NumViews] =
+        {
+            AM::ProjMat4 * AM::ViewMat4,
+            Deferred::GetLightSpaceMatrix(0),
+            Deferred::GetLightSpaceMatrix(1),
+            Deferred::GetLightSpaceMatrix(2),
+            Deferred::GetStaticCascadeMatrix(),
+            glm::mat4(1.0f), // Shadows, built from the cascade views
+            AM::ProjMat4 * AM::ViewMat4
+        };
+        qk::BeginGPUTimer("Culling");
+        Culling::CullViews(viewProj);
+        // The tiled path culls lights per tile while shading, only the clustered one reads the grid
+        if (Deferred::TiledShading) Lighting::UploadLights();
+        else Lighting::CullLights(AM::ProjMat4);
+        float time_Culling = qk::EndGPUTimer("Culling");
+        if (time_Culling != 0.0f) {
+            Culling_Timing = time_Culling;
+        }
+        
+        // GBuffers --------------------------
+        glBindFramebuffer(GL_FRAMEBUFFER, Deferred::GetGBufferFBO());
+        glViewport(0, 0, Deferred::GetRenderSize().x, Deferred::GetRenderSize().y);
+        qk::BeginGPUTimer("GBuffers");
+        Deferred::DrawGBuffers();
+        /* EDITOR ONLY */ Deferred::DrawMask(); // GMask, or GNormal alpha when packed, used for outline generation
+        float timing1 = qk::EndGPUTimer("GBuffers");
+        if (timing1 != 0.0f) {
+            GBuffers_Timing = timing1;
+        }
+
+        qk::BeginGPUTimer("Draw Shadows");
+        glBindFramebuffer(GL_FRAMEBUFFER, Deferred::GetShadowFBO());
+        Deferred::DrawShadows();
+        float time_DrawShadows = qk::EndGPUTimer("Draw Shadows");
+        if (time_DrawShadows != 0.0f) {
+            DrawShadows_Timing = time_DrawShadows;
+        }
+
+        qk::BeginGPUTimer("Calc Shadows");
+        glBindFramebuffer(GL_FRAMEBUFFER, Deferred::GetGBufferFBO());
+        Deferred::CalcShadows();
+        float time_CalcShadows = qk::EndGPUTimer("Calc Shadows");
+        if (time_CalcShadows != 0.0f) {
+            CalcShadows_Timing = time_CalcShadows;
+        }
+
+        qk::BeginGPUTimer("SSAO");
+        SSAO::Compute(Deferred::GBuffers[Deferred::GDepth], Deferred::GBuffers[Deferred::GNormal], Deferred::PackedGBuffer);
+        float time_SSAO = qk::EndGPUTimer("SSAO");
+        if (time_SSAO != 0.0f) {
+            SSAO_Timing = time_SSAO;
+        }
+        
+        // Draw deferred shaded to color attachment 0
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        qk::BeginGPUTimer("Shading");
+        Deferred::DoShading();
+        float time_Shading = qk::EndGPUTimer("Shading");
+        if (time_Shading != 0.0f) {
+            Shading_Timing = time_Shading;
+        }
+        /* EDITOR ONLY */ for (const auto& func : editorDraw3DEvents) { func(); }
+        // -------------------------------------------
+    }
+
     void Quit()
     {
         glDeleteFramebuffers(1, &Deferred::GetGBufferFBO());
@@ -45,4 +45,11 @@ namespace Engine
     void NewFrame();
     void Run();
     void Quit();
+
+    // For tests and tools, expects a current GL 4.6 context with GLAD loaded.
+    // Only the modules that render are initialized, there is no window, input or UI
+    void InitializeHeadless(int Width, int Height);
+
+    // Everything NewFrame draws before the display, from culling to shading
+    void RenderFrame();
 };
\ No newline at end of file
@@ -1,4 +1,7 @@
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <climits>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -8,6 +11,8 @@
 #include "scene_manager.h"
 #include "render_engine.h"
 #include "asset_manager.h"
+#include "culling/culling.h"
+#include "textures/textures.h"
 #include "../common/camera.h"
 #include "../common/qk.h"
 #include "../common/input.h"
@@ -26,13 +31,23 @@ namespace SM
         Engine::RegisterEditorDrawUIFunction(DrawLights);
         Engine::RegisterEditorDrawUIFunction(DrawOrigin);
         Engine::RegisterEditorFunction(NodeSelection);
+
+        // What every object drew with before materials
+        Material material;
+        material.albedo    = glm::vec3(0.80f, 0.65f, 0.60f);
+        material.roughness = 0.25f;
+        material.metallic  = 0.0f;
+        AddMaterial(material);
+
+        glGenBuffers(1, &MaterialSSBO);
+        UpdateMaterialSSBO();
     }
 
     void AddNode(Object* Object)
     {
         SceneNodes.push_back(Object);
         SceneNodeNames.push_back(Object->GetName());
-        UpdateDrawList();
+        AddToDrawList(Object);
 
         NumObjects++;
         _selectedSceneNode = SceneNodes.size() - 1;
@@ -49,6 +64,21 @@ namespace SM
         printf("Added light \"%s\"\n", Light->GetName().c_str());
     }
 
+    void RemoveNode(int Index)
+    {
+        if (Index < 0 || Index >= (int)SceneNodes.size()) return;
+
+        SceneNode* node = SceneNodes[Index];
+        if (node->GetType() == NodeType::Object_) {
+            RemoveFromDrawList(static_cast<Object*>(node));
+            NumObjects--;
+        }
+        else NumLights--;
+
+        SceneNodes.erase(SceneNodes.begin() + Index);
+        SceneNodeNames.erase(SceneNodeNames.begin() + Index);
+    }
+
     void SelectSceneNode(int Index)
     {
         _selectedSceneNode = glm::min(Index, (int)SceneNodes.size() - 1);
@@ -104,41 +134,401 @@ namespace SM
         }
     }
 
-    void UpdateDrawList()
+    void AddToDrawList(Object* Object)
     {
-        DrawList.clear();
+        Object->_inScene = true;
 
-        for (auto& node : SM::SceneNodes)
-        {
-            if (node->GetType() == SM::NodeType::Object_)
-            {
-                auto* object = static_cast<SM::Object*>(node);
-                const std::string& meshID = object->GetMeshID();
+        const std::string& meshID = Object->GetMeshID();
+        if (AM::Meshes.count(meshID)) DrawList[meshID].Insert(Object);
+        else PendingObjects[meshID].push_back(Object);
+    }
 
-                if (AM::Meshes.count(meshID))
-                    DrawList[meshID].Objects.push_back(object);
-            }
+    void RemoveFromDrawList(Object* Object)
+    {
+        Object->_inScene = false;
+
+        if (Object->_batch) {
+            Object->_batch->Remove(Object);
+            return;
+        }
+
+        auto pending = PendingObjects.find(Object->GetMeshID());
+        if (pending == PendingObjects.end()) return;
+
+        auto& waiting = pending->second;
+        auto it = std::find(waiting.begin(), waiting.end(), Object);
+        if (it != waiting.end()) {
+            *it = waiting.back();
+            waiting.pop_back();
+        }
+    }
+
+    void OnMeshLoaded(const std::string& MeshID)
+    {
+        auto pending = PendingObjects.find(MeshID);
+        if (pending == PendingObjects.end()) return;
+
+        InstanceBatch& batch = DrawList[MeshID];
+        batch.Objects.reserve(batch.Objects.size() + pending->second.size());
+
+        for (Object* object : pending->second)
+            batch.Insert(object);
+
+        PendingObjects.erase(pending);
+    }
+
+    size_t _dirtyBegin   = SIZE_MAX;
+    size_t _dirtyEnd     = 0;
+    size_t _ssboCapacity = 0;
+    bool   _drawLayoutDirty = true;
+
+    // CPU copy of the DrawIndex SSBO, between layouts only the entries that changed are patched
+    std::vector<unsigned int> _drawIndices;
+    size_t _drawIndexDirtyBegin = SIZE_MAX;
+    size_t _drawIndexDirtyEnd   = 0;
+    size_t _commandDirtyBegin   = SIZE_MAX;
+    size_t _commandDirtyEnd     = 0;
+
+    // Smallest run a batch gets, runs are laid out at twice the batch size
+    const unsigned int MIN_RUN_CAPACITY = 8;
+
+    void MarkInstanceDirty(unsigned int slot)
+    {
+        _dirtyBegin = std::min(_dirtyBegin, (size_t)slot);
+        _dirtyEnd   = std::max(_dirtyEnd,   (size_t)slot + 1);
+    }
+
+    // Upload frame each slot last moved in. Slots that moved during the previous upload still
+    // carry last frame's matrix as PrevModel and catch up once they stop moving.
+    uint64_t _instanceFrame = 1;
+    std::vector<uint64_t>     _slotMovedFrame;
+    std::vector<unsigned int> _movedSlots;
+    std::vector<unsigned int> _settlingSlots;
+
+    // Once per move instead of per vertex. Object matrices are TRS, so with uniform scale
+    // the inverse transpose is the model itself over the squared scale
+    void SetInstanceModel(unsigned int slot, const glm::mat4& model)
+    {
+        glm::mat3 m(model);
+        float sx = glm::dot(m[0], m[0]), sy = glm::dot(m[1], m[1]), sz = glm::dot(m[2], m[2]);
+
+        glm::mat3 normal;
+        if (std::abs(sx - sy) <= 1e-4f * sx && std::abs(sx - sz) <= 1e-4f * sx) normal = glm::mat3(m[0] / sx, m[1] / sx, m[2] / sx);
+        else normal = glm::transpose(glm::inverse(m));
+
+        Instances[slot].Model = model;
+        for (int i = 0; i < 3; i++)
+            Instances[slot].NormalMatrix[i] = glm::vec4(normal[i], 0.0f);
+    }
+
+    void MoveInstance(unsigned int slot, const glm::mat4& model)
+    {
+        if (_slotMovedFrame.size() <= slot) _slotMovedFrame.resize(Instances.size(), 0);
+
+        // PrevModel keeps the matrix the last upload had, however often it moves in between
+        if (_slotMovedFrame[slot] != _instanceFrame) {
+            _slotMovedFrame[slot] = _instanceFrame;
+            Instances[slot].PrevModel = Instances[slot].Model;
+            _movedSlots.push_back(slot);
+        }
+        SetInstanceModel(slot, model);
+        MarkInstanceDirty(slot);
+    }
+
+    void SetDrawIndex(InstanceBatch& Batch, size_t Index, unsigned int Slot)
+    {
+        size_t entry = Batch.RunStart + Index;
+        _drawIndices[entry]  = Slot;
+        _drawIndexDirtyBegin = std::min(_drawIndexDirtyBegin, entry);
+        _drawIndexDirtyEnd   = std::max(_drawIndexDirtyEnd,   entry + 1);
+    }
+
+    void UpdateInstanceCount(InstanceBatch& Batch)
+    {
+        DrawCommands[Batch.Command].InstanceCount = Batch.Objects.size();
+        _commandDirtyBegin = std::min(_commandDirtyBegin, (size_t)Batch.Command);
+        _commandDirtyEnd   = std::max(_commandDirtyEnd,   (size_t)Batch.Command + 1);
+    }
+
+    void InstanceBatch::Insert(Object* Object)
+    {
+        Object->_batch      = this;
+        Object->_batchIndex = Objects.size();
+        Objects.push_back(Object);
+
+        if (!FreeInstanceSlots.empty()) {
+            Object->_instanceSlot = FreeInstanceSlots.back();
+            FreeInstanceSlots.pop_back();
+        }
+        else {
+            Object->_instanceSlot = Instances.size();
+            Instances.emplace_back();
         }
+
+        // No motion on the first frame
+        SetInstanceModel(Object->_instanceSlot, Object->GetModelMatrix());
+        Instances[Object->_instanceSlot].PrevModel  = Object->GetModelMatrix();
+        Instances[Object->_instanceSlot].MaterialID = Object->GetMaterialID();
+        MarkInstanceDirty(Object->_instanceSlot);
+        Culling::SetInstanceBounds(Object->_instanceSlot, AM::Meshes.at(Object->GetMeshID()).aabb, Object->GetModelMatrix());
+        Object->_updateTextured();
+        if (!Object->_dynamic) StaticVersion++;
+
+        if (Command == UINT32_MAX || Objects.size() > RunCapacity) _drawLayoutDirty = true;
+        if (_drawLayoutDirty) return;
+
+        SetDrawIndex(*this, Object->_batchIndex, Object->_instanceSlot);
+        UpdateInstanceCount(*this);
+        Culling::SetInstanceBatch(Object->_instanceSlot, Command, Object->_dynamic);
     }
 
-    void UpdateInstanceMatrixSSBO()
+    void InstanceBatch::Remove(Object* Object)
     {
+        size_t index = Object->_batchIndex;
+        unsigned int slot = Object->_instanceSlot;
+        SM::Object* last = Objects.back();
+
+        Objects[index] = last;
+        last->_batchIndex = index;
+        Objects.pop_back();
+
+        FreeInstanceSlots.push_back(slot);
+        Object->_instanceSlot = UINT32_MAX;
+        Object->_batch = nullptr;
+        Object->_updateTextured();
+        if (!Object->_dynamic) StaticVersion++;
+
+        if (_drawLayoutDirty || Command == UINT32_MAX) return;
+
+        // The last object takes over the removed one's entry
+        if (index < Objects.size()) SetDrawIndex(*this, index, last->_instanceSlot);
+        UpdateInstanceCount(*this);
+        Culling::SetInstanceBatch(slot, UINT32_MAX, false);
+    }
+
+    // Every batch gets a run with room to grow, until one overflows inserts and removes only
+    // patch single entries
+    void RebuildDrawCommands()
+    {
+        _drawIndices.clear();
+        DrawCommands.clear();
+
         for (auto& [meshID, batch] : DrawList)
         {
-            size_t count = batch.Objects.size();
-            batch.ModelMats.resize(count);
+            const AM::Mesh& mesh = AM::Meshes.at(meshID);
+            batch.Command = UINT32_MAX;
+            if (mesh.IndexCount == 0) continue;
+
+            batch.Command     = DrawCommands.size();
+            batch.RunStart    = _drawIndices.size();
+            batch.RunCapacity = std::max((unsigned int)batch.Objects.size() * 2, MIN_RUN_CAPACITY);
+
+            DrawElementsIndirectCommand cmd;
+            cmd.Count         = mesh.IndexCount;
+            cmd.InstanceCount = batch.Objects.size();
+            cmd.FirstIndex    = mesh.FirstIndex;
+            cmd.BaseVertex    = mesh.BaseVertex;
+            cmd.BaseInstance  = batch.RunStart;
+            DrawCommands.push_back(cmd);
+
+            for (Object* object : batch.Objects)
+                _drawIndices.push_back(object->GetInstanceSlot());
+            _drawIndices.resize(batch.RunStart + batch.RunCapacity, 0);
+        }
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, DrawIndexSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, _drawIndices.size() * sizeof(unsigned int), _drawIndices.data(), GL_DYNAMIC_DRAW);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, DrawCommandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, DrawCommands.size() * sizeof(DrawElementsIndirectCommand), DrawCommands.data(), GL_DYNAMIC_DRAW);
+
+        Culling::UploadBatches();
+    }
+
+    void UploadDrawPatches()
+    {
+        if (_drawIndexDirtyBegin < _drawIndexDirtyEnd) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, DrawIndexSSBO);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                            _drawIndexDirtyBegin * sizeof(unsigned int),
+                            (_drawIndexDirtyEnd - _drawIndexDirtyBegin) * sizeof(unsigned int),
+                            _drawIndices.data() + _drawIndexDirtyBegin);
+        }
+
+        if (_commandDirtyBegin < _commandDirtyEnd) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, DrawCommandBuffer);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER,
+                            _commandDirtyBegin * sizeof(DrawElementsIndirectCommand),
+                            (_commandDirtyEnd - _commandDirtyBegin) * sizeof(DrawElementsIndirectCommand),
+                            DrawCommands.data() + _commandDirtyBegin);
+        }
+    }
+
+    void UpdateInstanceSSBO()
+    {
+        if (InstanceSSBO == 0) {
+            glGenBuffers(1, &InstanceSSBO);
+            glGenBuffers(1, &DrawIndexSSBO);
+            glGenBuffers(1, &DrawCommandBuffer);
+        }
+
+        for (unsigned int slot : _settlingSlots)
+        {
+            if (slot >= Instances.size() || _slotMovedFrame[slot] == _instanceFrame) continue;
+            Instances[slot].PrevModel = Instances[slot].Model;
+            MarkInstanceDirty(slot);
+        }
+        _settlingSlots.swap(_movedSlots);
+        _movedSlots.clear();
+        _instanceFrame++;
+
+        size_t count = Instances.size();
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, InstanceSSBO);
+
+        // Grow geometrically so a long run of insertions stays linear overall
+        if (count > _ssboCapacity) {
+            _ssboCapacity = std::max(count, _ssboCapacity * 2);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, _ssboCapacity * sizeof(InstanceData), nullptr, GL_DYNAMIC_DRAW);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(InstanceData), Instances.data());
+        }
+        else if (_dirtyBegin < std::min(_dirtyEnd, count)) {
+            size_t end = std::min(_dirtyEnd, count);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                            _dirtyBegin * sizeof(InstanceData),
+                            (end - _dirtyBegin) * sizeof(InstanceData),
+                            Instances.data() + _dirtyBegin);
+        }
+
+        _dirtyBegin = SIZE_MAX;
+        _dirtyEnd   = 0;
+
+        if (_drawLayoutDirty) {
+            RebuildDrawCommands();
+            _drawLayoutDirty = false;
+        }
+        else UploadDrawPatches();
+        Culling::UploadInstanceBatches();
+
+        _drawIndexDirtyBegin = _commandDirtyBegin = SIZE_MAX;
+        _drawIndexDirtyEnd   = _commandDirtyEnd   = 0;
+    }
+
+    void BindDrawBuffers()
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, InstanceSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, DrawIndexSSBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, MaterialSSBO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, DrawCommandBuffer);
+        glBindVertexArray(AM::Pool.VAO);
+    }
+
+    size_t _materialDirtyBegin = SIZE_MAX;
+    size_t _materialDirtyEnd   = 0;
+    size_t _materialCapacity   = 0;
+
+    void MarkMaterialDirty(unsigned int ID)
+    {
+        _materialDirtyBegin = std::min(_materialDirtyBegin, (size_t)ID);
+        _materialDirtyEnd   = std::max(_materialDirtyEnd,   (size_t)ID + 1);
+    }
+
+    MaterialData PackMaterial(const Material& m)
+    {
+        return { m.albedo, m.roughness, m.metallic, m.ao, m.albedoMap, m.metallicMap, m.roughnessMap, m.aoMap, { 0, 0 } };
+    }
+
+    unsigned int AddMaterial(const Material& Material)
+    {
+        Materials.push_back(Material);
+        MarkMaterialDirty(Materials.size() - 1);
+        return (unsigned int)Materials.size() - 1;
+    }
+
+    bool HasMaps(const Material& Material)
+    {
+        return Material.albedoMap >= 0 || Material.metallicMap >= 0 || Material.roughnessMap >= 0 || Material.aoMap >= 0;
+    }
+
+    void SetMaterial(unsigned int ID, const Material& Material)
+    {
+        if (ID >= Materials.size()) return;
+
+        bool hadMaps = HasMaps(Materials[ID]);
+        Materials[ID] = Material;
+        MarkMaterialDirty(ID);
+
+        // Rare, only when the material gains or loses its last map
+        if (hadMaps != HasMaps(Material))
+            for (auto& [meshID, batch] : DrawList)
+                for (Object* object : batch.Objects)
+                    if (object->_materialID == ID) object->_updateTextured();
+    }
+
+    // Same scheme as the instances, only the dirty range is packed and patched
+    void UpdateMaterialSSBO()
+    {
+        size_t count = Materials.size();
+        if (_materialDirtyBegin >= std::min(_materialDirtyEnd, count)) return;
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, MaterialSSBO);
+        if (count > _materialCapacity) {
+            _materialCapacity   = std::max(count, _materialCapacity * 2);
+            _materialDirtyBegin = 0;
+            _materialDirtyEnd   = count;
+            glBufferData(GL_SHADER_STORAGE_BUFFER, _materialCapacity * sizeof(MaterialData), nullptr, GL_DYNAMIC_DRAW);
+        }
+
+        size_t end = std::min(_materialDirtyEnd, count);
+        std::vector<MaterialData> data;
+        data.reserve(end - _materialDirtyBegin);
+        for (size_t i = _materialDirtyBegin; i < end; i++)
+            data.push_back(PackMaterial(Materials[i]));
+
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, _materialDirtyBegin * sizeof(MaterialData), data.size() * sizeof(MaterialData), data.data());
+
+        _materialDirtyBegin = SIZE_MAX;
+        _materialDirtyEnd   = 0;
+    }
+
+    std::vector<Object*> _texturedObjects;
 
-            for (size_t i = 0; i < count; ++i)
-                batch.ModelMats[i] = batch.Objects[i]->GetModelMatrix();
+    // Projected diameter of each textured object's world bounds, culled objects included
+    void RequestMaterialTextures()
+    {
+        float pixelsPerUnit = Engine::GetWindowSize().y / std::tan(glm::radians(AM::EditorCam.Fov) * 0.5f);
+        for (Object* object : _texturedObjects)
+        {
+            glm::vec3 center, extent;
+            Culling::GetInstanceBounds(object->GetInstanceSlot(), center, extent);
 
-            if (batch.SSBOIdx == 0)
-                glGenBuffers(1, &batch.SSBOIdx);
+            float radius   = glm::length(extent);
+            float distance = std::max(glm::length(center - AM::EditorCam.Position), radius);
+            float pixels   = radius / distance * pixelsPerUnit;
 
-            glBindBuffer(GL_SHADER_STORAGE_BUFFER, batch.SSBOIdx);
-            glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(glm::mat4), batch.ModelMats.data(), GL_DYNAMIC_DRAW);
+            const Material& material = Materials[object->GetMaterialID()];
+            for (int map : { material.albedoMap, material.metallicMap, material.roughnessMap, material.aoMap })
+                Textures::Request(map, pixels);
         }
     }
 
+    // Swap-removed like the batches, objects only count while they have an instance slot
+    void Object::_updateTextured()
+    {
+        bool textured = _instanceSlot != UINT32_MAX && _materialID < Materials.size() && HasMaps(Materials[_materialID]);
+        if (textured == (_texturedIndex != UINT32_MAX)) return;
+
+        if (textured) {
+            _texturedIndex = _texturedObjects.size();
+            _texturedObjects.push_back(this);
+            return;
+        }
+
+        Object* last = _texturedObjects.back();
+        _texturedObjects[_texturedIndex] = last;
+        last->_texturedIndex = _texturedIndex;
+        _texturedObjects.pop_back();
+        _texturedIndex = UINT32_MAX;
+    }
 
     Object* GetObjectFromNode(SceneNode* node)
     {
@@ -234,6 +624,12 @@ namespace SM
         _modelMatrix *= glm::mat4_cast(_rotationQuat);
         _modelMatrix = glm::scale(_modelMatrix, _scale);
 
+        if (_instanceSlot != UINT32_MAX) {
+            MoveInstance(_instanceSlot, _modelMatrix);
+            Culling::SetInstanceBounds(_instanceSlot, AM::Meshes.at(_meshID).aabb, _modelMatrix);
+            if (!_dynamic) StaticVersion++;
+        }
+
         // _modelMatrix = glm::rotate(_modelMatrix, glm::radians(_rotationEuler.x), glm::vec3(1.0f, 0.0f, 0.0f));
         // _modelMatrix = glm::rotate(_modelMatrix, glm::radians(_rotationEuler.y), glm::vec3(0.0f, 1.0f, 0.0f));
         // _modelMatrix = glm::rotate(_modelMatrix, glm::radians(_rotationEuler.z), glm::vec3(0.0f, 0.0f, 1.0f));
@@ -244,6 +640,28 @@ namespace SM
         _name = Name;
     }
 
+    void Object::SetMeshID(std::string MeshID)
+    {
+        if (MeshID == _meshID) return;
+
+        bool inScene = _inScene;
+        if (inScene) RemoveFromDrawList(this);
+        _meshID = MeshID;
+        if (inScene) AddToDrawList(this);
+    }
+
+    // Both static and dynamic casters of the cascades change, the culling batches carry the flag
+    void Object::SetDynamic(bool Dynamic)
+    {
+        if (Dynamic == _dynamic) return;
+
+        _dynamic = Dynamic;
+        if (_instanceSlot != UINT32_MAX) {
+            StaticVersion++;
+            if (!_drawLayoutDirty && _batch->Command != UINT32_MAX) Culling::SetInstanceBatch(_instanceSlot, _batch->Command, _dynamic);
+        }
+    }
+
     glm::vec3 Object::GetPosition()
     {
         return _position;
@@ -269,27 +687,50 @@ namespace SM
         return _meshID;
     }
 
+    // Only the instance slot changes, the object stays in its batch and draw
+    void Object::SetMaterialID(unsigned int MaterialID)
+    {
+        if (MaterialID == _materialID) return;
+
+        _materialID = MaterialID;
+        if (_instanceSlot != UINT32_MAX) {
+            Instances[_instanceSlot].MaterialID = MaterialID;
+            MarkInstanceDirty(_instanceSlot);
+            _updateTextured();
+        }
+    }
+
+    unsigned int Object::GetMaterialID()
+    {
+        return _materialID;
+    }
+
     glm::mat4 &Object::GetModelMatrix()
     {
         return _modelMatrix;
     }
 
+    unsigned int Object::GetInstanceSlot()
+    {
+        return _instanceSlot;
+    }
+
+    bool Object::IsDynamic()
+    {
+        return _dynamic;
+    }
+
     NodeType Object::GetType()
     {
         return _nodeType;
     }
 
+    // Triangles drawn into the camera view at the LODs that were selected,
+    // lags a frame or two behind in GPU culling mode
     void CalculateObjectsTriCount()
     {
-        int numtris = 0;
-
-        for (auto const& [meshID, batch] : SM::DrawList)
-        {
-            const auto& mesh = AM::Meshes.at(meshID);
-            numtris += mesh.TriangleCount * batch.Objects.size();
-        }
-
-        ObjectsTriCount = numtris;
+        long long numtris = Culling::Views[Culling::CameraView].Triangles;
+        ObjectsTriCount = (int)std::min(numtris, (long long)INT_MAX);
     }
 
     Light::Light(std::string Name, LightType Type)
@@ -364,6 +805,11 @@ namespace SM
         return _intensity;
     }
 
+    float Light::GetRadius()
+    {
+        return _radius;
+    }
+
     void NodeSelection()
     {
         float closestT = FLT_MAX;
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 #include <unordered_map>
 
 #include <glm/glm.hpp>
@@ -32,16 +33,19 @@ namespace SM
         float roughness = 0.5f;
         float ao = 1.0f;
     
-        // int useTextures = 0;
-        // int albedoMap = -1;
+        // Textures IDs, -1 for none. A map replaces its scalar, albedo is multiplied.
+        // Normal maps need tangents the vertex format doesn't carry yet
+        int albedoMap = -1;
         // int normalMap = -1;
-        // int metallicMap = -1;
-        // int roughnessMap = -1;
-        // int aoMap = -1;
+        int metallicMap = -1;
+        int roughnessMap = -1;
+        int aoMap = -1;
     
         Material() = default;
     };
 
+    struct InstanceBatch;
+
     class SceneNode
     {
         public:
@@ -67,6 +71,9 @@ namespace SM
             void Rotate(glm::vec3 Rotation);
             void SetScale(glm::vec3 Scale);
             void SetName(std::string Name);
+            void SetMeshID(std::string MeshID);
+            void SetDynamic(bool Dynamic);
+            void SetMaterialID(unsigned int MaterialID);
             void RecalculateMat4();
             
             glm::vec3   GetPosition();
@@ -75,7 +82,10 @@ namespace SM
             glm::vec3   GetScale();
             std::string GetName();
             std::string GetMeshID();
+            unsigned int GetMaterialID();
             glm::mat4   &GetModelMatrix();
+            unsigned int GetInstanceSlot();
+            bool         IsDynamic();
             NodeType GetType();
 
         private:
@@ -87,7 +97,26 @@ namespace SM
 
             std::string _name;
             std::string _meshID;
+            unsigned int _materialID = 0;
             NodeType _nodeType = NodeType::Object_;
+
+            // Back-reference into the DrawList so batches can be patched in O(1)
+            InstanceBatch* _batch        = nullptr;
+            size_t         _batchIndex   = 0;
+            unsigned int   _instanceSlot = UINT32_MAX;
+            bool           _inScene      = false;
+
+            // Dynamic objects are left out of the cached shadow layers and redrawn every frame
+            bool           _dynamic      = false;
+
+            // Index into the objects whose material has maps, only these request textures
+            unsigned int   _texturedIndex = UINT32_MAX;
+            void _updateTextured();
+
+            friend struct InstanceBatch;
+            friend void AddToDrawList(Object* Object);
+            friend void RemoveFromDrawList(Object* Object);
+            friend void SetMaterial(unsigned int ID, const Material& Material);
     };
 
     class Light : public SceneNode
@@ -103,6 +132,7 @@ namespace SM
             void  SetIntensity(float Intensity);
             void  SetRadius(float Radius);
             float GetIntensity();
+            float GetRadius();
 
             void SetName(std::string Name);
 
@@ -126,6 +156,7 @@ namespace SM
 
     void AddNode(Object* Object);
     void AddNode(Light* Object);
+    void RemoveNode(int Index);
 
     Object* GetObjectFromNode(SceneNode* node);
     Light*  GetLightFromNode(SceneNode* node);
@@ -136,20 +167,98 @@ namespace SM
     int  GetSelectedIndex();
     void FocusSelection(float screenPercentage = 0.5f);
 
-    void UpdateDrawList();
-    void UpdateInstanceMatrixSSBO();
+    void AddToDrawList(Object* Object);
+    void RemoveFromDrawList(Object* Object);
+    void OnMeshLoaded(const std::string& MeshID);
+    void UpdateInstanceSSBO();
+    void BindDrawBuffers();
+
+    // Appends to Materials and returns the ID
+    unsigned int AddMaterial(const Material& Material);
+    void SetMaterial(unsigned int ID, const Material& Material);
+    void UpdateMaterialSSBO();
+
+    // Screen-space demand of the material maps of every object that has any, for Textures::Update
+    void RequestMaterialTextures();
 
     inline std::vector<SceneNode*> SceneNodes;
     inline std::vector<std::string> SceneNodeNames;
 
+    // Objects are swap-removed, so order inside a batch is not stable.
+    // Each batch owns RunCapacity entries of the DrawIndex SSBO from RunStart and Command indexes
+    // its draw command and culling batch. Only a batch outgrowing its run changes the layout
     struct InstanceBatch
     {
         std::vector<Object*> Objects;
-        std::vector<glm::mat4> ModelMats;
-        unsigned int SSBOIdx;
+
+        unsigned int RunStart    = 0;
+        unsigned int RunCapacity = 0;
+        unsigned int Command     = UINT32_MAX;
+
+        void Insert(Object* Object);
+        void Remove(Object* Object);
     };
     inline std::unordered_map<std::string, InstanceBatch> DrawList;
 
+    // Objects whose mesh is still loading, moved into DrawList by OnMeshLoaded
+    inline std::unordered_map<std::string, std::vector<Object*>> PendingObjects;
+
+    // Matches the std430 layout of the Instances SSBO (binding 0) and res/shaders/common/instances.glsl.
+    // PrevModel is the model matrix of the previous frame, for motion vectors.
+    // NormalMatrix holds the columns of the mat3 inverse transpose of Model, padded as std430 lays out a mat3
+    struct InstanceData
+    {
+        glm::mat4    Model;
+        glm::mat4    PrevModel;
+        glm::vec4    NormalMatrix[3];
+        unsigned int MaterialID;
+        unsigned int Padding[3];
+    };
+
+    // Matches the std430 layout of the Materials SSBO (binding 15) and res/shaders/common/materials.glsl
+    struct MaterialData
+    {
+        glm::vec3 Albedo;
+        float     Roughness;
+        float     Metallic;
+        float     AO;
+        int       AlbedoMap;
+        int       MetallicMap;
+        int       RoughnessMap;
+        int       AOMap;
+        int       Padding[2];
+    };
+
+    // Indexed by material ID, 0 is the default every object starts with
+    inline std::vector<Material> Materials;
+    inline unsigned int MaterialSSBO;
+
+    // Layout defined by glMultiDrawElementsIndirect
+    struct DrawElementsIndirectCommand
+    {
+        unsigned int Count;
+        unsigned int InstanceCount;
+        unsigned int FirstIndex;
+        int          BaseVertex;
+        unsigned int BaseInstance;
+    };
+
+    // Every drawable object owns a stable slot for as long as it is in a batch,
+    // freed slots are reused. Only dirty slots get patched into the SSBO.
+    inline std::vector<InstanceData> Instances;
+    inline std::vector<unsigned int> FreeInstanceSlots;
+
+    // Bumped whenever a static object moves, enters or leaves the DrawList,
+    // cached shadow layers are rebuilt once it no longer matches theirs
+    inline unsigned int StaticVersion = 0;
+
+    // One command per batch, BaseInstance points at the batch's run of
+    // instance slots in the DrawIndex SSBO (binding 1)
+    inline std::vector<DrawElementsIndirectCommand> DrawCommands;
+    inline unsigned int InstanceSSBO;
+    inline unsigned int DrawIndexSSBO;
+    inline unsigned int DrawCommandBuffer;
+
     inline int ObjectsTriCount;
     inline int NumObjects;
     inline int NumLights;
@@ -0,0 +1,232 @@
+#include <iostream>
+#include <format>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "textures.h"
+#include "../asset_manager.h"
+#include "../../common/qk.h"
+#include "../../common/stat_counter.h"
+
+namespace Textures
+{
+    // Levels at or below this size are always resident once decoded
+    const int TAIL_SIZE = 64;
+
+    struct StreamedTexture
+    {
+        std::string     Path;
+        AM::TextureData Data;
+        bool     Decoded = false;
+        bool     Failed  = false;
+        int      TailMip = 0;
+        unsigned int GLTexture = 0;
+        uint64_t     Handle    = 0;
+        int   ResidentMip = -1;   // Top level on the GPU, -1 none
+        int   WantedMip   = -1;
+        float Demand      = 0.0f; // Largest screen size requested this frame
+        int   LowerFrames = 0;    // Frames the demand has asked for a coarser level
+    };
+
+    std::vector<StreamedTexture> _textures;
+    unsigned int _handleSSBO;
+    bool _handlesDirty = true;
+    bool _bindless     = false;
+    Residency _residency;
+
+    void Initialize()
+    {
+        _bindless = GLAD_GL_ARB_bindless_texture;
+        if (!_bindless) std::cout << "[:] ARB_bindless_texture unsupported, materials draw without textures\n";
+
+        glGenBuffers(1, &_handleSSBO);
+        Update();
+    }
+
+    int Load(const std::string& Path)
+    {
+        int id = (int)_textures.size();
+        _textures.emplace_back().Path = Path;
+
+        std::thread([id, Path]
+        {
+            auto data = std::make_shared<AM::TextureData>();
+            try { *data = AM::IO::LoadKtx2File(Stats::ProjectPath + "/" + Path); }
+            catch (const std::exception& e)
+            {
+                std::cout << "[!] " << e.what() << "\n";
+                qk::PostFunctionToMainThread([id] { _textures[id].Failed = true; });
+                return;
+            }
+
+            qk::PostFunctionToMainThread([id, data]
+            {
+                StreamedTexture& texture = _textures[id];
+                texture.Data    = std::move(*data);
+                texture.Decoded = true;
+
+                int size = std::max(texture.Data.Width, texture.Data.Height);
+                int last = (int)texture.Data.Mips.size() - 1;
+                texture.TailMip = 0;
+                while (texture.TailMip < last && (size >> texture.TailMip) > TAIL_SIZE) texture.TailMip++;
+            });
+        }).detach();
+
+        return id;
+    }
+
+    void Request(int Texture, float ScreenPixels)
+    {
+        if (Texture < 0 || Texture >= (int)_textures.size()) return;
+        _textures[Texture].Demand = std::max(_textures[Texture].Demand, ScreenPixels);
+    }
+
+    size_t BytesFrom(const StreamedTexture& Texture, int Mip)
+    {
+        size_t bytes = 0;
+        for (int i = std::max(Mip, 0); i < (int)Texture.Data.Mips.size(); i++) bytes += Texture.Data.Mips[i].size();
+        return bytes;
+    }
+
+    // Replaces the GPU copy with one holding the levels from Mip down, the old handle goes non-resident
+    void MakeResident(StreamedTexture& Texture, int Mip)
+    {
+        const AM::TextureData& data = Texture.Data;
+        int levels = (int)data.Mips.size() - Mip;
+        int width  = std::max(data.Width  >> Mip, 1);
+        int height = std::max(data.Height >> Mip, 1);
+
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, levels, data.Format, width, height);
+        for (int level = 0; level < levels; level++)
+        {
+            const std::vector<unsigned char>& mip = data.Mips[Mip + level];
+            int w = std::max(width >> level, 1);
+            int h = std::max(height >> level, 1);
+            if (data.Compressed) glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, data.Format, (int)mip.size(), mip.data());
+            else                 glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, mip.data());
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        if (GLAD_GL_EXT_texture_filter_anisotropic) glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 8.0f);
+
+        if (Texture.Handle) glMakeTextureHandleNonResidentARB(Texture.Handle);
+        if (Texture.GLTexture) glDeleteTextures(1, &Texture.GLTexture);
+
+        Texture.GLTexture   = texture;
+        Texture.ResidentMip = Mip;
+        Texture.Handle      = 0;
+        if (_bindless)
+        {
+            Texture.Handle = glGetTextureHandleARB(texture);
+            glMakeTextureHandleResidentARB(Texture.Handle);
+        }
+        _handlesDirty = true;
+    }
+
+    void Update()
+    {
+        // Level each texture wants, then the finest levels are given up until the budget holds
+        size_t wanted = 0, total = 0;
+        for (StreamedTexture& texture : _textures)
+        {
+            if (!texture.Decoded) continue;
+
+            int size = std::max(texture.Data.Width, texture.Data.Height);
+            int mip  = texture.Demand > 0.0f ? (int)std::floor(std::log2(size / texture.Demand)) : texture.TailMip;
+            texture.WantedMip = std::clamp(mip, 0, texture.TailMip);
+
+            wanted += BytesFrom(texture, texture.WantedMip);
+        }
+        total = wanted;
+        while (total > BudgetBytes)
+        {
+            StreamedTexture* coarsen = nullptr;
+            for (StreamedTexture& texture : _textures)
+            {
+                if (!texture.Decoded || texture.WantedMip >= texture.TailMip) continue;
+                if (!coarsen || texture.WantedMip < coarsen->WantedMip ||
+                    (texture.WantedMip == coarsen->WantedMip && texture.Demand < coarsen->Demand)) coarsen = &texture;
+            }
+            if (!coarsen) break;
+
+            total -= coarsen->Data.Mips[coarsen->WantedMip].size();
+            coarsen->WantedMip++;
+        }
+
+        // Largest demand first, the rest of the uploads wait for the next frames
+        std::vector<StreamedTexture*> order;
+        for (StreamedTexture& texture : _textures) if (texture.Decoded) order.push_back(&texture);
+        std::sort(order.begin(), order.end(), [](const StreamedTexture* a, const StreamedTexture* b) { return a->Demand > b->Demand; });
+
+        size_t resident = 0;
+        for (const StreamedTexture* texture : order) resident += BytesFrom(*texture, texture->ResidentMip);
+        bool overBudget = resident > BudgetBytes;
+
+        int uploads = 0;
+        for (StreamedTexture* texture : order)
+        {
+            // New textures only get their small tail right away, finer levels take the capped path later
+            if (texture->ResidentMip < 0) MakeResident(*texture, texture->TailMip);
+            else if (texture->WantedMip < texture->ResidentMip)
+            {
+                texture->LowerFrames = 0;
+                if (uploads++ < UPLOADS_PER_FRAME) MakeResident(*texture, texture->WantedMip);
+            }
+            else if (texture->WantedMip > texture->ResidentMip)
+            {
+                if (++texture->LowerFrames >= DROP_FRAMES || overBudget) MakeResident(*texture, texture->WantedMip);
+            }
+            else texture->LowerFrames = 0;
+
+            texture->Demand = 0.0f;
+        }
+
+        _residency = Residency();
+        _residency.Textures    = (int)_textures.size();
+        _residency.WantedBytes = wanted;
+        for (const StreamedTexture& texture : _textures)
+        {
+            if (!texture.Decoded) { _residency.Decoding += !texture.Failed; continue; }
+            if (texture.ResidentMip == 0) _residency.Full++;
+            _residency.ResidentBytes += BytesFrom(texture, texture.ResidentMip);
+        }
+
+        if (!_handlesDirty) return;
+        _handlesDirty = false;
+
+        // Never left empty so the binding stays valid
+        std::vector<uint64_t> handles(std::max<size_t>(_textures.size(), 1), 0);
+        for (size_t i = 0; i < _textures.size(); i++) handles[i] = _textures[i].Handle;
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _handleSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, handles.size() * sizeof(uint64_t), handles.data(), GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, _handleSSBO);
+    }
+
+    bool Bindless()
+    {
+        return _bindless;
+    }
+
+    Residency GetResidency()
+    {
+        return _residency;
+    }
+
+    int GetResidentMip(int Texture)
+    {
+        if (Texture < 0 || Texture >= (int)_textures.size()) return -1;
+        return _textures[Texture].ResidentMip;
+    }
+}
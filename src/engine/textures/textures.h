@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace Textures
+{
+    // Streamed textures. Load decodes on a background thread and keeps every level in memory, the GPU
+    // only holds the levels from each texture's resident mip down. Update moves that mip toward the
+    // screen-space demand of the frame within BudgetBytes, by swapping in a texture object with more
+    // or fewer levels. Shaders find them by ID in the bindless handle table (SSBO binding 16), a zero
+    // handle is not resident yet or bindless textures are unsupported
+    inline size_t BudgetBytes = size_t(256) << 20;
+
+    // Uploads are spread over frames, drops wait until the demand has stayed lower for a while
+    const int UPLOADS_PER_FRAME = 2;
+    const int DROP_FRAMES       = 90;
+
+    struct Residency
+    {
+        int    Textures = 0;
+        int    Decoding = 0;
+        int    Full     = 0; // Level 0 resident
+        size_t ResidentBytes = 0;
+        size_t WantedBytes   = 0; // With every demand met
+    };
+
+    void Initialize();
+
+    // The ID is valid right away, the texture samples as missing until its first levels are up
+    int Load(const std::string& Path);
+
+    // Demand of this frame, the texture spans about ScreenPixels on screen
+    void Request(int Texture, float ScreenPixels);
+
+    // Once per frame after the demand is in, applies residency changes and uploads changed handles
+    void Update();
+
+    bool Bindless();
+    Residency GetResidency();
+
+    // Top level on the GPU, -1 while decoding or for an unknown ID
+    int GetResidentMip(int Texture);
+}
@@ -1,11 +1,13 @@
 #include "engine/render_engine.h"
 #include "engine/asset_manager.h"
 #include "engine/scene_manager.h"
+#include "engine/textures/textures.h"
 #include "common/command_parser.h"
 #include "common/stat_counter.h"
 
 #include <ctime>
 #include <iostream>
+#include <algorithm>
 
 int main()
 {
@@ -31,6 +33,11 @@ int main()
     AM::IO::LoadObjAsync("res/objs/sphere.obj",         meshIDs[12]);
     AM::IO::LoadObjAsync("res/objs/cube.obj",           meshIDs[13]);
 
+    // Tiles for the cubes, tinted by their random albedo
+    int tilesAlbedo    = Textures::Load("res/textures/checker_albedo.ktx2");
+    int tilesRoughness = Textures::Load("res/textures/tiles_roughness.ktx2");
+    std::vector<std::string> cubeIDs = { meshIDs[3], meshIDs[6], meshIDs[10], meshIDs[13] };
+
     int num = 7;
     int spacing = 4;
 
@@ -57,6 +64,13 @@ int main()
         float rz = static_cast<float>(rand() % 360);
         myobj->Rotate(glm::vec3(rx, ry, rz));
 
+        // A material of its own, the batches stay per mesh
+        SM::Material material;
+        material.albedo    = glm::vec3(rand() % 256, rand() % 256, rand() % 256) / 255.0f;
+        material.roughness = 0.1f + 0.8f * (rand() % 101) / 100.0f;
+        material.metallic  = (rand() % 4 == 0) ? 1.0f : 0.0f;
+        myobj->SetMaterialID(SM::AddMaterial(material));
+
         SM::AddNode(myobj);
         createdObjects.push_back(myobj);  // Track for cleanup
     }
@@ -83,7 +83,10 @@ namespace UI
          Menu qk;
          Menu debug;
 
-    std::vector<std::string> MN_DebugItems = { "None", "BVH", "Deferred", "Stats", "Shadow Map" };
+    std::vector<std::string> MN_DebugItems = { "None", "BVH", "Deferred", "Stats", "Shadow Map", "Shading: Tiled" };
+
+    // Items past the debug views switch renderer paths instead
+    const int DebugViewCount = 5;
 
     bool inMenu       = false;
     bool grabbingMenu = false;
@@ -873,17 +876,29 @@ namespace UI
         }
     }
 
+    void SelectDebugItem(int index)
+    {
+        if (index < DebugViewCount) {
+            Engine::debugMode = static_cast<Engine::DebugMode>(index + 1);
+            return;
+        }
+
+        Deferred::TiledShading = !Deferred::TiledShading;
+        MN_DebugItems[DebugViewCount] = Deferred::TiledShading ? "Shading: Tiled" : "Shading: Fragment";
+        RecalcMenuWidths(toplevelmenu);
+    }
+
     void DebugInput()
     {
         if (Input::KeyPressed(GLFW_KEY_ENTER))
-            Engine::debugMode = static_cast<Engine::DebugMode>(debug.SelectedSubMenu + 1);
+            SelectDebugItem(debug.SelectedSubMenu);
 
-        for (int key = GLFW_KEY_1; key <= GLFW_KEY_5; ++key) {
+        for (int key = GLFW_KEY_1; key <= GLFW_KEY_1 + DebugViewCount; ++key) {
             if (Input::KeyPressed(key))
             {
                 int submenuIndex = key - GLFW_KEY_1;
                 debug.SelectedSubMenu = submenuIndex;
-                Engine::debugMode = static_cast<Engine::DebugMode>(submenuIndex + 1);
+                SelectDebugItem(submenuIndex);
             }
         }
     }
@@ -0,0 +1,185 @@
+#include <iostream>
+#include <format>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "headless_context.h"
+#include "../src/engine/render_engine.h"
+#include "../src/engine/asset_manager.h"
+#include "../src/engine/scene_manager.h"
+#include "../src/engine/culling/culling.h"
+
+// Culls a fixed instance set on the GPU and checks the compacted counts of every
+// view against the CPU path, which shares its bounds, LOD and cluster rules. Then
+// removes, adds and flips objects without outgrowing any run and checks again
+
+struct Counts
+{
+    int       Visible[Culling::NumViews];
+    long long Triangles[Culling::NumViews];
+};
+
+struct Config
+{
+    const char* Name;
+    bool LayeredShadows;
+    bool LayerMasks;
+    bool ClusterCulling;
+};
+
+void buildScene()
+{
+    const char* meshes[] = { "sphere", "suzanne", "teapot", "cube" };
+    for (const char* mesh : meshes)
+        AM::AddMeshByData(AM::IO::LoadObjFile(std::format("res/objs/{}.obj", mesh)), mesh);
+
+    // Spread far enough that LODs, every cascade and the frustum edges all come into play
+    int num     = 10;
+    int spacing = 6;
+    for (int i = 0; i < num * num * num; i++)
+    {
+        SM::Object* object = new SM::Object("obj_" + std::to_string(i), meshes[i % 4]);
+        object->SetPosition(glm::vec3(
+            (i % num) * spacing - ((num - 1) * spacing) / 2.0f,
+            (i / num % num) * spacing,
+            (i / (num * num)) * spacing - ((num - 1) * spacing) / 2.0f
+        ));
+        object->Rotate(glm::vec3(i * 37 % 360, i * 91 % 360, i * 13 % 360));
+        object->SetScale(glm::vec3(0.5f + (i % 7) * 0.25f));
+        object->SetDynamic(i % 5 == 0);
+        SM::AddNode(object);
+    }
+    SM::UpdateInstanceSSBO();
+}
+
+SM::Object* addObject(int i)
+{
+    const char* meshes[] = { "sphere", "suzanne", "teapot", "cube" };
+    SM::Object* object = new SM::Object("added_" + std::to_string(i), meshes[i % 4]);
+    object->SetPosition(glm::vec3(i % 9 * 4.0f - 16.0f, 2.0f, i / 9 * 4.0f - 16.0f));
+    object->SetDynamic(i % 3 == 0);
+    SM::AddNode(object);
+    return object;
+}
+
+// Patches must not move any run, and every run has to hold exactly its batch's slots
+bool patchScene()
+{
+    std::vector<unsigned int> runs;
+    for (const SM::DrawElementsIndirectCommand& cmd : SM::DrawCommands) runs.push_back(cmd.BaseInstance);
+
+    for (int i = 0; i < 120; i++) SM::RemoveNode((i * 7919) % SM::SceneNodes.size());
+    for (int i = 0; i < 60; i++) addObject(i);
+    for (int i = 0; i < 40; i++) {
+        SM::Object* object = SM::GetObjectFromNode(SM::SceneNodes[i * 13]);
+        object->SetDynamic(!object->IsDynamic());
+    }
+    SM::UpdateInstanceSSBO();
+
+    bool kept = SM::DrawCommands.size() == runs.size();
+    for (size_t i = 0; kept && i < runs.size(); i++) kept = SM::DrawCommands[i].BaseInstance == runs[i];
+
+    size_t entries = 0;
+    for (const SM::DrawElementsIndirectCommand& cmd : SM::DrawCommands) entries = std::max<size_t>(entries, cmd.BaseInstance + cmd.InstanceCount);
+    std::vector<unsigned int> drawIndices(entries);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, SM::DrawIndexSSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, entries * sizeof(unsigned int), drawIndices.data());
+
+    bool filled = true;
+    for (auto& [meshID, batch] : SM::DrawList)
+    {
+        const SM::DrawElementsIndirectCommand& cmd = SM::DrawCommands[batch.Command];
+        filled = filled && cmd.InstanceCount == batch.Objects.size();
+        for (size_t i = 0; filled && i < batch.Objects.size(); i++)
+            filled = drawIndices[cmd.BaseInstance + i] == batch.Objects[i]->GetInstanceSlot();
+    }
+
+    std::cout << std::format("\n[{}] Runs {} after removing 120, adding 60 and flipping 40, DrawIndex SSBO {}\n",
+                             kept && filled ? ':' : '!', kept ? "kept" : "moved", filled ? "matches" : "doesn't match");
+    return kept && filled;
+}
+
+Counts cull(Culling::Mode Mode, const glm::mat4 ViewProj[Culling::NumViews])
+{
+    Culling::CullingMode = Mode;
+    Culling::CullViews(ViewProj);
+    Culling::WaitForGPUStats();
+
+    Counts counts;
+    for (int i = 0; i < Culling::NumViews; i++) {
+        counts.Visible[i]   = Culling::Views[i].Visible;
+        counts.Triangles[i] = Culling::Views[i].Triangles;
+    }
+    return counts;
+}
+
+int main()
+{
+    if (!Headless::CreateContext()) return Headless::SKIP;
+    Engine::InitializeHeadless(1280, 720);
+
+    buildScene();
+
+    AM::EditorCam = Camera(glm::vec3(-40.0f, 50.0f, -35.0f), AM::EditorCam.Fov, 45.0f, -20.0f);
+    glm::mat4 camera = AM::ProjMat4 * AM::EditorCam.GetViewMatrix();
+
+    // Nested boxes around the camera like the cascade fit, looking down the sun direction
+    glm::mat4 lightView = glm::lookAt(glm::vec3(20.0f, 80.0f, 30.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::mat4 viewProj[Culling::NumViews] =
+    {
+        camera,
+        glm::ortho(-15.0f, 15.0f, -15.0f, 15.0f, 0.0f, 200.0f) * lightView,
+        glm::ortho(-35.0f, 35.0f, -35.0f, 35.0f, 0.0f, 200.0f) * lightView,
+        glm::ortho(-80.0f, 80.0f, -80.0f, 80.0f, 0.0f, 200.0f) * lightView,
+        glm::ortho(-35.0f, 35.0f, -35.0f, 35.0f, 0.0f, 200.0f) * lightView,
+        glm::mat4(1.0f),
+        camera
+    };
+
+    // The cascades split casters the way the shadow cache does
+    Culling::ViewCasters[Culling::Cascade1]      = Culling::DynamicCasters;
+    Culling::ViewCasters[Culling::CascadeStatic] = Culling::StaticCasters;
+    Culling::OcclusionCulling = false; // The CPU path has no depth pyramid
+
+    const Config configs[] =
+    {
+        { "Per cascade",           false, false, false },
+        { "Per cascade, clusters", false, false, true  },
+        { "Layered, VS",           true,  false, true  },
+        { "Layered, GS",           true,  true,  true  },
+    };
+
+    int mismatches = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        if (pass == 1 && !patchScene()) mismatches++;
+
+        for (const Config& config : configs)
+        {
+            Culling::LayeredShadows = config.LayeredShadows;
+            Culling::LayerMasks     = config.LayerMasks;
+            Culling::ClusterCulling = config.ClusterCulling;
+
+            Counts cpu = cull(Culling::CPU, viewProj);
+            Counts gpu = cull(Culling::GPU, viewProj);
+
+            std::cout << std::format("\n[>] {}{}\n", config.Name, pass == 1 ? ", patched" : "");
+            for (int i = 0; i < Culling::NumViews; i++)
+            {
+                bool match = cpu.Visible[i] == gpu.Visible[i] && cpu.Triangles[i] == gpu.Triangles[i];
+                std::cout << std::format("[{}] {:<15} CPU {:>5} visible {:>9} triangles, GPU {:>5} visible {:>9} triangles\n", match ? ':' : '!',
+                                         Culling::ViewToString(Culling::ViewID(i)), cpu.Visible[i], cpu.Triangles[i], gpu.Visible[i], gpu.Triangles[i]);
+                if (!match) mismatches++;
+            }
+        }
+    }
+
+    std::cout << std::format("\n[{}] {} mismatched views\n", mismatches == 0 ? ':' : '!', mismatches);
+
+    Headless::DestroyContext();
+    return mismatches == 0 ? 0 : 1;
+}
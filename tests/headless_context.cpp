@@ -0,0 +1,110 @@
+#include <iostream>
+#include <format>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#ifdef MAEVE_TESTS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "headless_context.h"
+
+namespace Headless
+{
+    GLFWwindow* _window = nullptr;
+
+#ifdef MAEVE_TESTS_EGL
+    EGLDisplay _display = EGL_NO_DISPLAY;
+    EGLContext _context = EGL_NO_CONTEXT;
+
+    bool createEGLContext()
+    {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay) _display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (_display == EGL_NO_DISPLAY) _display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (_display == EGL_NO_DISPLAY || !eglInitialize(_display, nullptr, nullptr)) return false;
+
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            eglTerminate(_display);
+            return false;
+        }
+
+        // Nothing is drawn to an EGL surface, surfaceless displays may not offer any config
+        const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config      = EGL_NO_CONFIG_KHR;
+        EGLint    configCount = 0;
+        if (!eglChooseConfig(_display, configAttributes, &config, 1, &configCount) || configCount == 0) config = EGL_NO_CONFIG_KHR;
+
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION,       4,
+            EGL_CONTEXT_MINOR_VERSION,       6,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        _context = eglCreateContext(_display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (_context == EGL_NO_CONTEXT || !eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, _context)) {
+            std::cout << std::format("[!] EGL has no GL 4.6 core context (0x{:x}), Mesa needs MESA_GL_VERSION_OVERRIDE=4.6\n", eglGetError());
+            eglTerminate(_display);
+            _context = EGL_NO_CONTEXT;
+            return false;
+        }
+
+        return gladLoadGLLoader((GLADloadproc)eglGetProcAddress);
+    }
+#endif
+
+    bool createGLFWContext()
+    {
+        if (!glfwInit()) return false;
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+        _window = glfwCreateWindow(64, 64, "Maeve tests", NULL, NULL);
+        if (!_window) {
+            glfwTerminate();
+            return false;
+        }
+        glfwMakeContextCurrent(_window);
+
+        return gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+    }
+
+    bool CreateContext()
+    {
+        bool created = false;
+#ifdef MAEVE_TESTS_EGL
+        created = createEGLContext();
+#endif
+        if (!created) created = createGLFWContext();
+
+        if (!created) {
+            std::cout << "[!] Couldn't create a headless GL 4.6 context\n";
+            return false;
+        }
+
+        std::cout << std::format("[:] {} | {}\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+        return true;
+    }
+
+    void DestroyContext()
+    {
+#ifdef MAEVE_TESTS_EGL
+        if (_context != EGL_NO_CONTEXT) {
+            eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(_display, _context);
+            eglTerminate(_display);
+            _context = EGL_NO_CONTEXT;
+        }
+#endif
+        if (_window) {
+            glfwDestroyWindow(_window);
+            glfwTerminate();
+            _window = nullptr;
+        }
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+// Offscreen GL 4.6 context for the tests, GLAD is loaded once it is current.
+// EGL surfaceless first, which is what Mesa llvmpipe offers in CI, then a hidden GLFW window.
+namespace Headless
+{
+    // Returned by a test that found no context, CTest reports it as skipped
+    constexpr int SKIP = 77;
+
+    bool CreateContext();
+    void DestroyContext();
+}
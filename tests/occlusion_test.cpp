@@ -0,0 +1,128 @@
+#include <iostream>
+#include <format>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "headless_context.h"
+#include "../src/engine/render_engine.h"
+#include "../src/engine/asset_manager.h"
+#include "../src/engine/scene_manager.h"
+#include "../src/engine/culling/culling.h"
+#include "../src/engine/deferred/deffered_manager.h"
+
+// Renders a row of spheres in front of a wall and a grid of them behind it, culled on the GPU
+// with the two occlusion phases. With a warm pyramid the early phase alone has to draw everything
+// in front and reject everything behind. Once the wall is gone the early phase still rejects what
+// it hid, the late phase has to bring exactly those back
+
+const int WIDTH  = 320;
+const int HEIGHT = 180;
+
+const int FRONT  = 5;
+const int BEHIND = 20;
+
+int failures = 0;
+
+void check(bool Passed, const std::string& What)
+{
+    std::cout << std::format("[{}] {}\n", Passed ? ':' : '!', What);
+    if (!Passed) failures++;
+}
+
+SM::Object* buildScene()
+{
+    AM::AddMeshByData(AM::IO::LoadObjFile("res/objs/sphere.obj"), "sphere");
+
+    // Fills the whole view, the cube preset spans -1 to 1
+    SM::Object* wall = new SM::Object("wall", "MV::CUBE");
+    wall->SetScale(glm::vec3(40.0f, 0.5f, 40.0f));
+    SM::AddNode(wall);
+
+    for (int i = 0; i < FRONT; i++)
+    {
+        SM::Object* object = new SM::Object("front_" + std::to_string(i), "sphere");
+        object->SetPosition(glm::vec3(i * 2.0f - 4.0f, -5.0f, 1.0f));
+        SM::AddNode(object);
+    }
+
+    for (int i = 0; i < BEHIND; i++)
+    {
+        SM::Object* object = new SM::Object("behind_" + std::to_string(i), "sphere");
+        object->SetPosition(glm::vec3(i % 5 * 2.0f - 4.0f, 4.0f + i / 5 * 2.0f, i % 3 - 1.0f));
+        object->SetDynamic(i % 4 == 0);
+        SM::AddNode(object);
+    }
+
+    // Behind the camera, outside the frustum in both halves
+    for (int i = 0; i < 4; i++)
+    {
+        SM::Object* object = new SM::Object("outside_" + std::to_string(i), "sphere");
+        object->SetPosition(glm::vec3(i * 2.0f, -20.0f, 0.0f));
+        SM::AddNode(object);
+    }
+
+    return wall;
+}
+
+// Instances inside the camera frustum, from the CPU path which has no occlusion test
+int frustumVisible()
+{
+    glm::mat4 camera = AM::ProjMat4 * AM::EditorCam.GetViewMatrix();
+    glm::mat4 viewProj[Culling::NumViews];
+    for (glm::mat4& view : viewProj) view = camera;
+
+    Culling::CullingMode = Culling::CPU;
+    Culling::CullViews(viewProj);
+    Culling::CullingMode = Culling::GPU;
+    return Culling::Views[Culling::CameraView].Visible;
+}
+
+// Early and late draws of the last frame, the camera view's count includes the late one
+void renderFrame(int& Drawn, int& Late)
+{
+    Engine::RenderFrame();
+    Culling::WaitForGPUStats();
+    Drawn = Culling::Views[Culling::CameraView].Visible;
+    Late  = Culling::Views[Culling::CameraLate].Visible;
+}
+
+int main()
+{
+    if (!Headless::CreateContext()) return Headless::SKIP;
+    Engine::InitializeHeadless(WIDTH, HEIGHT);
+    Deferred::SetDynamicResolution(false);
+
+    Culling::CullingMode      = Culling::GPU;
+    Culling::OcclusionCulling = true;
+
+    SM::Object* wall = buildScene();
+    AM::EditorCam = Camera(glm::vec3(0.0f, -12.0f, 1.0f), AM::EditorCam.Fov, -90.0f, 0.0f);
+
+    // The first frame has no pyramid and draws the frustum, the ones after cull against the last
+    int drawn, late;
+    renderFrame(drawn, late);
+    int frustum = frustumVisible();
+    check(frustum == 1 + FRONT + BEHIND, std::format("{} instances in the frustum, the wall, {} in front and {} behind", frustum, FRONT, BEHIND));
+    check(drawn == frustum, std::format("Cold pyramid draws the whole frustum, {} of {}", drawn, frustum));
+
+    for (int frame = 0; frame < 3; frame++) renderFrame(drawn, late);
+    check(drawn == 1 + FRONT && late == 0,
+          std::format("Warm pyramid draws the wall and the {} in front, {} drawn, {} of them late", FRONT, drawn, late));
+    check(frustum - drawn == BEHIND, std::format("{} behind the wall rejected, {} expected", frustum - drawn, BEHIND));
+
+    // The early phase still sees the wall in last frame's depth, the late phase must not
+    wall->SetPosition(glm::vec3(0.0f, 0.0f, -200.0f));
+    renderFrame(drawn, late);
+    frustum = frustumVisible();
+    check(drawn == frustum && late == BEHIND,
+          std::format("Without the wall early and late draw the frustum, {} of {}, {} of them late", drawn, frustum, late));
+
+    renderFrame(drawn, late);
+    check(drawn == frustum && late == 0, std::format("The next frame draws them early, {} drawn, {} of them late", drawn, late));
+
+    std::cout << std::format("\n[{}] {} failed checks\n", failures == 0 ? ':' : '!', failures);
+
+    Headless::DestroyContext();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+#include <iostream>
+#include <fstream>
+#include <format>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <filesystem>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "headless_context.h"
+#include "../src/engine/render_engine.h"
+#include "../src/engine/asset_manager.h"
+#include "../src/engine/scene_manager.h"
+#include "../src/engine/deferred/deffered_manager.h"
+
+// Renders a fixed scene for a fixed number of frames and compares the resolved TAA history
+// against a committed reference. The jitter runs through Deferred's eight Halton(2, 3) phases
+// from the first frame, so every run accumulates the same sequence.
+// Pass --update to rewrite the reference after an intended change to the output
+
+const int WIDTH  = 320;
+const int HEIGHT = 180;
+const int FRAMES = 24; // Three jitter cycles
+
+// The reference comes from Mesa llvmpipe, what CI runs, where reruns match exactly. The slack is
+// for rasterization and draw order differences between versions, halving the jitter phases fails
+const int   CHANNEL_TOLERANCE   = 8;
+const float MAX_OUTLIER_PERCENT = 0.25f;
+const float MAX_MEAN_ERROR      = 0.5f;
+
+struct Image
+{
+    int Width  = 0;
+    int Height = 0;
+    std::vector<unsigned char> RGB;
+};
+
+bool readPPM(const std::string& Path, Image& Image)
+{
+    std::ifstream file(Path, std::ios::binary);
+    std::string magic;
+    int maxValue;
+    file >> magic >> Image.Width >> Image.Height >> maxValue;
+    if (!file || magic != "P6" || maxValue != 255) return false;
+    file.get();
+
+    Image.RGB.resize(Image.Width * Image.Height * 3);
+    file.read((char*)Image.RGB.data(), Image.RGB.size());
+    return (bool)file;
+}
+
+bool writePPM(const std::string& Path, const Image& Image)
+{
+    std::ofstream file(Path, std::ios::binary);
+    file << std::format("P6\n{} {}\n255\n", Image.Width, Image.Height);
+    file.write((const char*)Image.RGB.data(), Image.RGB.size());
+    return (bool)file;
+}
+
+// History to 8 bit, rows flipped so the file reads top down
+Image readHistory()
+{
+    std::vector<float> pixels(WIDTH * HEIGHT * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTextureImage(Deferred::GetTemporalHistory(), 0, GL_RGB, GL_FLOAT, pixels.size() * sizeof(float), pixels.data());
+
+    Image image;
+    image.Width  = WIDTH;
+    image.Height = HEIGHT;
+    image.RGB.resize(pixels.size());
+    for (int y = 0; y < HEIGHT; y++)
+        for (int x = 0; x < WIDTH * 3; x++)
+            image.RGB[(HEIGHT - 1 - y) * WIDTH * 3 + x] = (unsigned char)std::lround(glm::clamp(pixels[y * WIDTH * 3 + x], 0.0f, 1.0f) * 255.0f);
+    return image;
+}
+
+void buildScene()
+{
+    const char* meshes[] = { "sphere", "suzanne", "teapot" };
+    for (const char* mesh : meshes)
+        AM::AddMeshByData(AM::IO::LoadObjFile(std::format("res/objs/{}.obj", mesh)), mesh);
+
+    // The plane preset faces +Y, the world is Z up
+    SM::Object* ground = new SM::Object("ground", "MV::PLANE");
+    ground->Rotate(glm::vec3(90.0f, 0.0f, 0.0f));
+    ground->SetScale(glm::vec3(8.0f));
+    SM::AddNode(ground);
+
+    glm::vec3 albedos[] = { glm::vec3(0.9f, 0.2f, 0.2f), glm::vec3(0.2f, 0.8f, 0.3f), glm::vec3(0.3f, 0.4f, 0.9f) };
+    for (int i = 0; i < 9; i++)
+    {
+        SM::Object* object = new SM::Object("obj_" + std::to_string(i), meshes[i % 3]);
+        object->SetPosition(glm::vec3((i % 3) * 3.0f - 3.0f, (i / 3) * 3.0f - 3.0f, 1.0f));
+        object->Rotate(glm::vec3(i * 40.0f, 0.0f, i * 25.0f));
+
+        SM::Material material;
+        material.albedo    = albedos[i % 3];
+        material.roughness = 0.2f + 0.1f * i;
+        material.metallic  = i % 4 == 0 ? 1.0f : 0.0f;
+        object->SetMaterialID(SM::AddMaterial(material));
+        SM::AddNode(object);
+    }
+
+    SM::AddNode(new SM::Light("light", SM::Point, glm::vec3(0.0f, 0.0f, 3.0f), 8.0f, glm::vec3(1.0f, 0.9f, 0.8f), 2.0f));
+}
+
+int main(int argc, char** argv)
+{
+    std::string reference = "tests/reference/taa_resolve.ppm";
+    bool update = argc > 1 && std::string(argv[1]) == "--update";
+
+    if (!Headless::CreateContext()) return Headless::SKIP;
+    Engine::InitializeHeadless(WIDTH, HEIGHT);
+
+    // Frame times must not steer the resolution
+    Deferred::SetDynamicResolution(false);
+    Deferred::SetTemporalAA(true);
+
+    buildScene();
+
+    // A slow dolly and a spinning object, so the history is reprojected through camera and object motion
+    AM::EditorCam = Camera(glm::vec3(0.0f, -9.0f, 5.0f), AM::EditorCam.Fov, -90.0f, -30.0f);
+    SM::Object* spinning = SM::GetObjectFromNode(SM::SceneNodes[5]);
+    spinning->SetDynamic(true);
+
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        AM::EditorCam.SetPosition(AM::EditorCam.Position + glm::vec3(0.02f, 0.0f, 0.0f));
+        spinning->Rotate(glm::vec3(0.0f, 0.0f, 2.0f));
+
+        Engine::RenderFrame();
+        Deferred::ResolveTemporal();
+    }
+    glFinish();
+
+    Image actual = readHistory();
+    if (update) {
+        bool written = writePPM(reference, actual);
+        std::cout << std::format("[{}] Wrote {}\n", written ? ':' : '!', reference);
+        Headless::DestroyContext();
+        return written ? 0 : 1;
+    }
+
+    Image expected;
+    if (!readPPM(reference, expected) || expected.Width != WIDTH || expected.Height != HEIGHT) {
+        std::cout << std::format("[!] Couldn't read a {}x{} reference from {}\n", WIDTH, HEIGHT, reference);
+        Headless::DestroyContext();
+        return 1;
+    }
+
+    long long totalError = 0;
+    int outliers = 0;
+    for (size_t i = 0; i < actual.RGB.size(); i++)
+    {
+        int error = std::abs(int(actual.RGB[i]) - int(expected.RGB[i]));
+        totalError += error;
+        if (error > CHANNEL_TOLERANCE) outliers++;
+    }
+    float meanError      = float(totalError) / actual.RGB.size();
+    float outlierPercent = 100.0f * outliers / actual.RGB.size();
+    bool  passed         = meanError <= MAX_MEAN_ERROR && outlierPercent <= MAX_OUTLIER_PERCENT;
+
+    std::cout << std::format("[{}] {} frames, mean error {:.3f} (max {:.2f}), {:.3f}% of channels off by more than {} (max {:.2f}%)\n",
+                             passed ? ':' : '!', FRAMES, meanError, MAX_MEAN_ERROR, outlierPercent, CHANNEL_TOLERANCE, MAX_OUTLIER_PERCENT);
+    if (!passed) {
+        std::string path = (std::filesystem::temp_directory_path() / "taa_resolve_actual.ppm").string();
+        if (writePPM(path, actual)) std::cout << std::format("[:] Wrote the rendered history to {}\n", path);
+    }
+
+    Headless::DestroyContext();
+    return passed ? 0 : 1;
+}
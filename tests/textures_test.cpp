@@ -0,0 +1,131 @@
+#include <iostream>
+#include <format>
+#include <string>
+#include <chrono>
+#include <thread>
+
+#include "headless_context.h"
+#include "../src/engine/render_engine.h"
+#include "../src/engine/asset_manager.h"
+#include "../src/engine/textures/textures.h"
+#include "../src/common/qk.h"
+
+// Streams three copies of the same texture through Textures::Update and checks the mip each one
+// ends up with against the demand, the upload cap, the drop delay and the budget. Only the
+// residency is tested, which works without bindless handles
+
+const char* ALBEDO    = "res/textures/checker_albedo.ktx2";
+const char* ROUGHNESS = "res/textures/tiles_roughness.ktx2";
+
+int failures = 0;
+
+void check(bool Passed, const std::string& What)
+{
+    std::cout << std::format("[{}] {}\n", Passed ? ':' : '!', What);
+    if (!Passed) failures++;
+}
+
+// RGBA8 bytes of every level from Mip down, for a square texture of Size
+size_t bytesFrom(int Size, int Mip)
+{
+    size_t bytes = 0;
+    for (int size = Size >> Mip; size >= 1; size /= 2) bytes += (size_t)size * size * 4;
+    return bytes;
+}
+
+void frame(const int Textures[3], const float Demand[3])
+{
+    for (int i = 0; i < 3; i++) Textures::Request(Textures[i], Demand[i]);
+    Textures::Update();
+}
+
+std::string mips(const int Textures[3])
+{
+    return std::format("{}, {}, {}", Textures::GetResidentMip(Textures[0]), Textures::GetResidentMip(Textures[1]), Textures::GetResidentMip(Textures[2]));
+}
+
+void testDecode()
+{
+    // 256x256 with only level 0 stored, the loader box filters the rest
+    AM::TextureData albedo = AM::IO::LoadKtx2File(ALBEDO);
+    check(albedo.Mips.size() == 9 && albedo.Mips[8].size() == 4, std::format("{} decodes to {} levels", ALBEDO, albedo.Mips.size()));
+
+    const std::vector<unsigned char>& level0 = albedo.Mips[0];
+    int boxed = (level0[0] + level0[4] + level0[256 * 4] + level0[256 * 4 + 4] + 2) / 4;
+    check(albedo.Mips[1][0] == boxed, std::format("Level 1 is the box filtered level 0, {} for {}", albedo.Mips[1][0], boxed));
+
+    // 128x128 with the whole chain stored
+    AM::TextureData roughness = AM::IO::LoadKtx2File(ROUGHNESS);
+    bool sizes = roughness.Mips.size() == 8;
+    for (size_t i = 0; sizes && i < roughness.Mips.size(); i++) sizes = roughness.Mips[i].size() == bytesFrom(128, i) - bytesFrom(128, i + 1);
+    check(sizes, std::format("{} reads its {} stored levels", ROUGHNESS, roughness.Mips.size()));
+}
+
+void testStreaming()
+{
+    const int SIZE = 256;
+    const int TAIL = 2; // 64 pixels
+    int textures[3] = { Textures::Load(ALBEDO), Textures::Load(ALBEDO), Textures::Load(ALBEDO) };
+
+    // Without demand a decoded texture only gets its tail
+    auto start = std::chrono::steady_clock::now();
+    while (Textures::GetResidency().Decoding > 0 || Textures::GetResidentMip(textures[2]) < 0)
+    {
+        if (std::chrono::steady_clock::now() - start > std::chrono::seconds(10)) break;
+        qk::ExecuteMainThreadTasks();
+        Textures::Update();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    bool tails = true;
+    for (int texture : textures) tails = tails && Textures::GetResidentMip(texture) == TAIL;
+    check(tails, std::format("Decoded textures start at their tail, mips {}", mips(textures)));
+
+    // A full screen of demand wants level 0, uploads are capped per frame
+    float full[3] = { 256.0f, 256.0f, 256.0f };
+    frame(textures, full);
+    int uploaded = 0;
+    for (int texture : textures) uploaded += Textures::GetResidentMip(texture) == 0;
+    check(uploaded == Textures::UPLOADS_PER_FRAME, std::format("{} of 3 reach level 0 in the first frame, mips {}", uploaded, mips(textures)));
+
+    frame(textures, full);
+    Textures::Residency residency = Textures::GetResidency();
+    check(residency.Full == 3 && residency.ResidentBytes == 3 * bytesFrom(SIZE, 0),
+          std::format("All 3 reach level 0 in the next, {} bytes resident", residency.ResidentBytes));
+
+    // Half the demand wants level 1, given back only once it has stayed lower for DROP_FRAMES
+    float lower[3] = { 128.0f, 256.0f, 256.0f };
+    for (int i = 0; i < Textures::DROP_FRAMES - 1; i++) frame(textures, lower);
+    check(Textures::GetResidentMip(textures[0]) == 0, std::format("Level 0 kept for {} frames of lower demand", Textures::DROP_FRAMES - 1));
+    frame(textures, lower);
+    check(Textures::GetResidentMip(textures[0]) == 1, std::format("Level 1 after {}, mips {}", Textures::DROP_FRAMES, mips(textures)));
+
+    // Room for one full chain and two from level 1. The finest levels of the smallest demand go
+    // first, and an over budget GPU drops them right away
+    size_t budget = Textures::BudgetBytes;
+    Textures::BudgetBytes = bytesFrom(SIZE, 0) + 2 * bytesFrom(SIZE, 1);
+    float ranked[3] = { 256.0f, 200.0f, 150.0f };
+    frame(textures, ranked);
+    residency = Textures::GetResidency();
+    check(mips(textures) == "0, 1, 1" && residency.ResidentBytes <= Textures::BudgetBytes,
+          std::format("Over budget the smaller demands drop to level 1, mips {}, {} of {} bytes", mips(textures), residency.ResidentBytes, Textures::BudgetBytes));
+    check(residency.WantedBytes == 3 * bytesFrom(SIZE, 0), std::format("Wanted still counts every demand, {} bytes", residency.WantedBytes));
+
+    Textures::BudgetBytes = budget;
+    frame(textures, full);
+    check(mips(textures) == "0, 0, 0", std::format("Back at level 0 once the budget allows, mips {}", mips(textures)));
+}
+
+int main()
+{
+    if (!Headless::CreateContext()) return Headless::SKIP;
+    Engine::InitializeHeadless(320, 180);
+
+    std::cout << std::format("[:] Bindless textures {}\n", Textures::Bindless() ? "supported" : "unsupported, handles stay zero");
+    testDecode();
+    testStreaming();
+
+    std::cout << std::format("\n[{}] {} failed checks\n", failures == 0 ? ':' : '!', failures);
+
+    Headless::DestroyContext();
+    return failures == 0 ? 0 : 1;
+}